@@ -0,0 +1,256 @@
+// bench.cpp
+// Multi-client fairness benchmark: N concurrent downloads against the server, of which
+// `greedy` clients pipeline `c` requests per batch, as the part 3/4 rogue client does.
+// Reports per-client completion times, Jain's fairness index and aggregate throughput.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdio>
+
+// JSON parser
+std::map<std::string, std::string> parse_config(const std::string& filename) {
+    std::map<std::string, std::string> config;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t quote1 = line.find('\"');
+        if (quote1 == std::string::npos) continue;
+        size_t quote2 = line.find('\"', quote1 + 1);
+        if (quote2 == std::string::npos) continue;
+
+        std::string key = line.substr(quote1 + 1, quote2 - quote1 - 1);
+
+        size_t colon = line.find(':', quote2);
+        if (colon == std::string::npos) continue;
+
+        size_t val_start = line.find_first_not_of(" \t,", colon + 1);
+        if (val_start == std::string::npos) continue;
+
+        size_t val_end = line.find_last_not_of(" \t,");
+        std::string value = line.substr(val_start, val_end - val_start + 1);
+
+        if (value.front() == '\"' && value.back() == '\"') {
+            value = value.substr(1, value.length() - 2);
+        }
+        config[key] = value;
+    }
+    return config;
+}
+
+struct ClientResult {
+    bool greedy = false;
+    bool ok = false;
+    double elapsed_ms = 0;
+    long long words = 0;
+    long long bytes = 0;
+    long long requests = 0;
+    // TCP_INFO at the end of the download
+    unsigned rtt_us = 0, cwnd = 0, total_retrans = 0;
+    unsigned long long delivery_rate = 0;
+};
+
+// All clients connect first, then start together
+struct StartGate {
+    std::mutex mu;
+    std::condition_variable cv;
+    int waiting = 0;
+    int total = 0;
+    void arrive_and_wait() {
+        std::unique_lock<std::mutex> lock(mu);
+        if (++waiting == total) cv.notify_all();
+        else cv.wait(lock, [this] { return waiting == total; });
+    }
+};
+
+int connect_to(const std::string& ip, int port, const std::string& congestion) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    if (!congestion.empty() && setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, congestion.c_str(), congestion.size()) < 0) {
+        perror("congestion");
+    }
+    struct sockaddr_in serv_addr = {};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (inet_pton(AF_INET, ip.c_str(), &serv_addr.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Download the corpus from p in batches of `c` pipelined "p,k" requests. Words are
+// counted from the comma count of each line instead of being split into strings, so
+// the driver stays far cheaper per byte than the server it measures.
+void run_client(const std::string& ip, int port, const std::string& congestion, int p, int k, int c, StartGate& gate,
+                ClientResult& res) {
+    int sock = connect_to(ip, port, congestion);
+    gate.arrive_and_wait();
+    if (sock < 0) return;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<char> buf(1 << 16);
+    size_t head = 0, tail = 0;
+    std::string requests;
+    long long offset = p;
+    bool eof = false, failed = false;
+    while (!eof && !failed) {
+        requests.clear();
+        for (int i = 0; i < c; ++i) requests += std::to_string(offset + static_cast<long long>(i) * k) + "," + std::to_string(k) + "\n";
+        if (send(sock, requests.data(), requests.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(requests.size())) break;
+        res.requests += c;
+        offset += static_cast<long long>(c) * k;
+
+        // Read c response lines; lines may straddle reads
+        int lines = 0;
+        long long commas = 0;
+        size_t line_start = head;
+        while (lines < c) {
+            if (head == tail) {
+                if (line_start < tail && line_start > 0) {
+                    std::copy(buf.begin() + line_start, buf.begin() + tail, buf.begin());
+                    tail -= line_start;
+                    head = tail;
+                    line_start = 0;
+                } else if (line_start == tail) {
+                    head = tail = line_start = 0;
+                }
+                if (tail == buf.size()) buf.resize(buf.size() * 2);
+                ssize_t n = read(sock, buf.data() + tail, buf.size() - tail);
+                if (n <= 0) { failed = true; break; }
+                tail += n;
+                res.bytes += n;
+            }
+            char ch = buf[head++];
+            if (ch == ',') {
+                commas++;
+            } else if (ch == '\n') {
+                size_t len = head - 1 - line_start;
+                bool has_eof = len >= 3 && std::equal(buf.begin() + head - 4, buf.begin() + head - 1, "EOF");
+                // A line of n words has n-1 commas; an ",EOF" tail adds one comma and no word
+                if (has_eof) {
+                    res.words += commas;
+                    eof = true;
+                } else if (len > 0) {
+                    res.words += commas + 1;
+                }
+                commas = 0;
+                line_start = head;
+                lines++;
+            }
+        }
+    }
+    res.elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    res.ok = eof;
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) {
+        res.rtt_us = info.tcpi_rtt;
+        res.cwnd = info.tcpi_snd_cwnd;
+        res.total_retrans = info.tcpi_total_retrans;
+        res.delivery_rate = info.tcpi_delivery_rate;
+    }
+    close(sock);
+}
+
+// Jain's index over utilities 1/completion_time, as in the part 3 runner
+double jain_index(const std::vector<double>& times_ms) {
+    double sum = 0, sum_sq = 0;
+    for (double t : times_ms) {
+        double u = 1000.0 / t;
+        sum += u;
+        sum_sq += u * u;
+    }
+    return sum_sq > 0 ? (sum * sum) / (times_ms.size() * sum_sq) : 0.0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string config_path = "config.json";
+    std::string csv_path;
+    std::string congestion;
+    int clients = -1, greedy = -1, c = -1, k = -1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--config" && i + 1 < argc) config_path = argv[++i];
+        else if (arg == "--clients" && i + 1 < argc) clients = std::stoi(argv[++i]);
+        else if (arg == "--greedy" && i + 1 < argc) greedy = std::stoi(argv[++i]);
+        else if (arg == "--c" && i + 1 < argc) c = std::stoi(argv[++i]);
+        else if (arg == "--k" && i + 1 < argc) k = std::stoi(argv[++i]);
+        else if (arg == "--csv" && i + 1 < argc) csv_path = argv[++i];
+        else if (arg == "--congestion" && i + 1 < argc) congestion = argv[++i];
+    }
+
+    auto config = parse_config(config_path);
+    auto get = [&config](const std::string& key, int def) { return config.count(key) ? std::stoi(config[key]) : def; };
+    std::string server_ip = config["server_ip"];
+    int port = config.count("server_port") ? std::stoi(config["server_port"]) : get("port", 5000);
+    int p = get("p", 0);
+    if (clients < 0) clients = get("num_clients", 10);
+    if (greedy < 0) greedy = get("greedy_clients", 1);
+    if (c < 0) c = get("c", 1);
+    if (k < 0) k = get("k", 5);
+    if (congestion.empty()) congestion = config["congestion"];
+    clients = std::max(1, clients);
+    greedy = std::min(std::max(0, greedy), clients);
+    c = std::max(1, c);
+
+    StartGate gate;
+    gate.total = clients;
+    std::vector<ClientResult> results(clients);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < clients; ++i) {
+        results[i].greedy = i < greedy;
+        threads.emplace_back(run_client, server_ip, port, congestion, p, k, results[i].greedy ? c : 1, std::ref(gate), std::ref(results[i]));
+    }
+    for (auto& t : threads) t.join();
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> times, greedy_times, normal_times;
+    long long total_bytes = 0, total_words = 0;
+    for (int i = 0; i < clients; ++i) {
+        const auto& r = results[i];
+        printf("CLIENT %d %s ok=%d elapsed_ms=%.2f words=%lld requests=%lld rtt_us=%u cwnd=%u retrans=%u delivery_rate=%llu\n",
+               i, r.greedy ? "greedy" : "normal", r.ok, r.elapsed_ms, r.words, r.requests, r.rtt_us, r.cwnd, r.total_retrans,
+               r.delivery_rate);
+        if (!r.ok) continue;
+        times.push_back(r.elapsed_ms);
+        (r.greedy ? greedy_times : normal_times).push_back(r.elapsed_ms);
+        total_bytes += r.bytes;
+        total_words += r.words;
+    }
+    auto mean = [](const std::vector<double>& v) {
+        double s = 0;
+        for (double x : v) s += x;
+        return v.empty() ? 0.0 : s / v.size();
+    };
+    printf("COMPLETED:%zu/%d\n", times.size(), clients);
+    printf("MEAN_MS:%.2f GREEDY_MEAN_MS:%.2f NORMAL_MEAN_MS:%.2f\n", mean(times), mean(greedy_times), mean(normal_times));
+    printf("JFI:%.4f\n", times.empty() ? 0.0 : jain_index(times));
+    printf("THROUGHPUT_MBPS:%.2f WORDS_PER_S:%.0f WALL_MS:%.2f\n", total_bytes * 8 / 1000.0 / wall_ms,
+           total_words * 1000.0 / wall_ms, wall_ms);
+
+    if (!csv_path.empty()) {
+        std::ofstream csv(csv_path, std::ios::app);
+        for (int i = 0; i < clients; ++i) {
+            const auto& r = results[i];
+            csv << clients << "," << c << "," << i << "," << (r.greedy ? "greedy" : "normal") << "," << r.ok << ","
+                << r.elapsed_ms << "," << r.rtt_us << "," << r.cwnd << "," << r.total_retrans << "," << r.delivery_rate << "\n";
+        }
+    }
+    return times.size() == static_cast<size_t>(clients) ? 0 : 1;
+}
@@ -4,11 +4,27 @@
 #include <vector>
 #include <map>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+#include <sys/time.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <chrono>
 #include <fstream>
 #include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include "fold.h"
+#include "tcp_info.h"
+#include <thread>
+#include <mutex>
+#ifdef WORD_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
 
 // JSON parser
 std::map<std::string, std::string> parse_config(const std::string& filename) {
@@ -53,11 +69,735 @@ void split(const std::string& s, char delimiter, std::vector<std::string>& token
     tokens.push_back(s.substr(start));
 }
 
+// Normalization applied to received words as they are counted, mirroring the server's
+// tokenizer options: "delimiters" splits words further (\n, \t and \r escapes allowed),
+// "trim" strips ASCII whitespace and "fold_case" (ascii or unicode) folds case
+struct WordNorm {
+    bool delim[256] = {};
+    bool split = false;
+    bool trim = false;
+    enum { None, Ascii, Unicode } fold = None;
+    bool active() const { return split || trim || fold != None; }
+};
+
+// Count the normalized tokens of one received word
+void count_normalized(const std::string& word, const WordNorm& norm, std::map<std::string, int>& freq_map, std::string& scratch) {
+    size_t start = 0;
+    while (start <= word.size()) {
+        size_t end = start;
+        while (norm.split && end < word.size() && !norm.delim[static_cast<unsigned char>(word[end])]) ++end;
+        if (!norm.split) end = word.size();
+        size_t a = start, b = end;
+        if (norm.trim) {
+            while (a < b && isspace(static_cast<unsigned char>(word[a]))) ++a;
+            while (b > a && isspace(static_cast<unsigned char>(word[b - 1]))) --b;
+        }
+        if (b > a) {
+            scratch.clear();
+            if (norm.fold == WordNorm::None) scratch.append(word, a, b - a);
+            else fold_word(word.data() + a, b - a, norm.fold == WordNorm::Unicode, scratch);
+            freq_map[scratch]++;
+        }
+        start = end + 1;
+    }
+}
+
+// TLS on the main connection (--tls, build with make TLS=1). Requests and replies go
+// through OpenSSL here; whether records are offloaded to the kernel is up to each side.
+#ifdef WORD_TLS
+SSL* tls_session = nullptr;
+int tls_sock = -1;
+
+// With a CA file the server's certificate must chain to it and name the server:
+// name is a host name (also sent as SNI) or an IP address
+bool tls_connect(int sock, const std::string& ca_file, const std::string& name) {
+    SSL_CTX* tls = SSL_CTX_new(TLS_client_method());
+    if (!tls) return false;
+    SSL_CTX_set_options(tls, SSL_OP_ENABLE_KTLS);
+    if (!ca_file.empty()) {
+        if (SSL_CTX_load_verify_locations(tls, ca_file.c_str(), nullptr) != 1) {
+            ERR_print_errors_fp(stderr);
+            return false;
+        }
+        SSL_CTX_set_verify(tls, SSL_VERIFY_PEER, nullptr);
+    }
+    tls_session = SSL_new(tls);
+    SSL_set_fd(tls_session, sock);
+    if (!ca_file.empty()) {
+        struct in_addr ip;
+        bool checked = inet_pton(AF_INET, name.c_str(), &ip) == 1
+                           ? X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(tls_session), name.c_str()) == 1
+                           : SSL_set1_host(tls_session, name.c_str()) == 1 && SSL_set_tlsext_host_name(tls_session, name.c_str()) == 1;
+        if (!checked) {
+            ERR_print_errors_fp(stderr);
+            return false;
+        }
+    }
+    if (SSL_connect(tls_session) != 1) {
+        ERR_print_errors_fp(stderr);
+        return false;
+    }
+    tls_sock = sock;
+    return true;
+}
+#endif
+
+// read() and send() that go through TLS on the main connection
+ssize_t sock_read(int sock, char* buf, size_t len) {
+#ifdef WORD_TLS
+    if (sock == tls_sock) {
+        size_t n = 0;
+        return SSL_read_ex(tls_session, buf, len, &n) ? static_cast<ssize_t>(n) : -1;
+    }
+#endif
+    return read(sock, buf, len);
+}
+
+ssize_t sock_send(int sock, const char* buf, size_t len, int flags) {
+#ifdef WORD_TLS
+    if (sock == tls_sock) {
+        size_t n = 0;
+        return SSL_write_ex(tls_session, buf, len, &n) ? static_cast<ssize_t>(n) : -1;
+    }
+#endif
+    return send(sock, buf, len, flags);
+}
+
+// Read one newline-terminated line, keeping any extra bytes in buf for the next call
+bool read_line(int sock, std::string& buf, std::string& line) {
+    size_t nl;
+    while ((nl = buf.find('\n')) == std::string::npos) {
+        char chunk[4096];
+        ssize_t bytes_read = sock_read(sock, chunk, sizeof(chunk));
+        if (bytes_read <= 0) return false;
+        buf.append(chunk, bytes_read);
+    }
+    line = buf.substr(0, nl);
+    buf.erase(0, nl + 1);
+    return true;
+}
+
+// Add the words of one response line; returns true once the line carries EOF
+bool consume_chunk(const std::string& response, std::vector<std::string>& all_words) {
+    if (response.find("EOF") != std::string::npos) {
+        std::string final_part = response.substr(0, response.find("EOF"));
+        if (!final_part.empty() && final_part.back() == ',') final_part.pop_back();
+        if (!final_part.empty()) split(final_part, ',', all_words);
+        return true;
+    }
+    split(response, ',', all_words);
+    return false;
+}
+
+// Wait until buf holds at least n bytes
+bool fill(int sock, std::string& buf, size_t n) {
+    while (buf.size() < n) {
+        char chunk[4096];
+        ssize_t bytes_read = sock_read(sock, chunk, sizeof(chunk));
+        if (bytes_read <= 0) return false;
+        buf.append(chunk, bytes_read);
+    }
+    return true;
+}
+
+uint32_t get_le(const std::string& buf, size_t at, int bytes) {
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | static_cast<unsigned char>(buf[at + i]);
+    return v;
+}
+
+// Read one counted frame ("MODE binary" or "MODE ids", dict given) into all_words.
+// eof receives the frame's EOF flag and frame_bytes its size on the wire.
+bool read_frame(int sock, std::string& buf, const std::vector<std::string>* dict,
+                std::vector<std::string>& all_words, bool& eof, size_t& frame_bytes) {
+    if (!fill(sock, buf, 5)) return false;
+    uint32_t count = get_le(buf, 0, 4);
+    eof = buf[4] & 1;
+    size_t at = 5;
+    for (uint32_t i = 0; i < count; ++i) {
+        if (dict) {
+            if (!fill(sock, buf, at + 4)) return false;
+            uint32_t id = get_le(buf, at, 4);
+            if (id >= dict->size()) return false;
+            all_words.push_back((*dict)[id]);
+            at += 4;
+        } else {
+            if (!fill(sock, buf, at + 2)) return false;
+            size_t len = get_le(buf, at, 2);
+            if (!fill(sock, buf, at + 2 + len)) return false;
+            all_words.push_back(buf.substr(at + 2, len));
+            at += 2 + len;
+        }
+    }
+    buf.erase(0, at);
+    frame_bytes = at;
+    return true;
+}
+
+// Open a TCP connection, or return -1. A non-empty congestion names the
+// TCP_CONGESTION algorithm to use (e.g. "cubic", "bbr" if loaded).
+int connect_to(const std::string& ip, int port, const std::string& congestion = "") {
+    int sock = 0;
+    struct sockaddr_in serv_addr;
+    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) { return -1; }
+    if (!congestion.empty() && setsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, congestion.c_str(), congestion.size()) < 0) {
+        perror("congestion");
+    }
+
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+
+    if (inet_pton(AF_INET, ip.c_str(), &serv_addr.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Shared chunk table for a download spread over several replicas. Each replica
+// connection pulls the next unclaimed chunk as soon as it finishes one, so faster
+// replicas naturally take more. Once every chunk is claimed, idle connections
+// re-request the chunk that has been outstanding longest (endgame), so a replica that
+// stalls or dies stops holding up the download. A replica that sends nothing for
+// timeout_ms hands its chunk back and is dropped, and once every chunk is in the
+// remaining connections are shut down so no worker stays blocked in a read.
+struct Swarm {
+    std::mutex mu;
+    std::vector<int> socks;
+    int p = 0, k = 1, num_chunks = 0, next_chunk = 0, remaining = 0;
+    std::vector<char> done;
+    std::vector<std::chrono::steady_clock::time_point> issued;
+    std::vector<std::vector<std::string>> chunks;
+    std::vector<int> served;  // chunks delivered per replica
+};
+
+// Claim a chunk for a replica: the next fresh one, else the oldest still outstanding
+int claim_chunk(Swarm& sw, int last) {
+    std::lock_guard<std::mutex> lock(sw.mu);
+    auto now = std::chrono::steady_clock::now();
+    if (sw.next_chunk < sw.num_chunks) {
+        sw.issued[sw.next_chunk] = now;
+        return sw.next_chunk++;
+    }
+    int oldest = -1;
+    for (int i = 0; i < sw.num_chunks; ++i) {
+        if (!sw.done[i] && i != last && (oldest < 0 || sw.issued[i] < sw.issued[oldest])) oldest = i;
+    }
+    if (oldest >= 0) sw.issued[oldest] = now;
+    return oldest;
+}
+
+void swarm_worker(Swarm& sw, int sock, int replica) {
+    std::string inbuf, response;
+    int last = -1;
+    while (true) {
+        int idx = claim_chunk(sw, last);
+        if (idx < 0) break;
+        std::string request = std::to_string(sw.p + idx * sw.k) + "," + std::to_string(sw.k) + "\n";
+        if (sock_send(sock, request.c_str(), request.length(), 0) <= 0 || !read_line(sock, inbuf, response)) {
+            // Timed out or failed: give the chunk back, first in line for the others
+            std::lock_guard<std::mutex> lock(sw.mu);
+            if (!sw.done[idx]) sw.issued[idx] = std::chrono::steady_clock::time_point();
+            break;
+        }
+        std::vector<std::string> words;
+        consume_chunk(response, words);
+        std::lock_guard<std::mutex> lock(sw.mu);
+        if (!sw.done[idx]) {
+            sw.chunks[idx] = std::move(words);
+            sw.done[idx] = 1;
+            sw.remaining--;
+            sw.served[replica]++;
+        }
+        if (sw.remaining == 0) {
+            for (int other : sw.socks) shutdown(other, SHUT_RDWR);
+            break;
+        }
+        last = idx;
+    }
+}
+
+// Download [p, end) from all replicas at once; they must agree on the corpus version
+bool swarm_download(const std::vector<std::pair<std::string, int>>& replicas, int p, int k, int timeout_ms,
+                    std::vector<std::string>& all_words) {
+    Swarm sw;
+    sw.p = p;
+    sw.k = std::max(1, k);
+    std::vector<int> socks;
+    std::string version;
+    long long size = -1;
+    for (const auto& r : replicas) {
+        int sock = connect_to(r.first, r.second);
+        if (sock < 0) { std::cerr << "Replica " << r.first << ":" << r.second << " unreachable" << std::endl; continue; }
+        struct timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        // OPEN doubles as a handshake: "OK version,size"
+        std::string inbuf, line, req = "OPEN 0,1\n";
+        sock_send(sock, req.c_str(), req.length(), 0);
+        if (!read_line(sock, inbuf, line) || line.compare(0, 3, "OK ") != 0) { close(sock); continue; }
+        size_t comma = line.find(',');
+        std::string v = line.substr(3, comma - 3);
+        if (version.empty()) { version = v; size = std::stoll(line.substr(comma + 1)); }
+        if (v != version) {
+            std::cerr << "Replica " << r.first << ":" << r.second << " has a different corpus version" << std::endl;
+            close(sock);
+            continue;
+        }
+        socks.push_back(sock);
+    }
+    if (socks.empty()) return false;
+
+    sw.num_chunks = size > p ? static_cast<int>((size - p + sw.k - 1) / sw.k) : 0;
+    sw.remaining = sw.num_chunks;
+    sw.done.assign(sw.num_chunks, 0);
+    sw.issued.resize(sw.num_chunks);
+    sw.chunks.resize(sw.num_chunks);
+    sw.served.assign(socks.size(), 0);
+
+    sw.socks = socks;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < socks.size(); ++i) threads.emplace_back(swarm_worker, std::ref(sw), socks[i], static_cast<int>(i));
+    for (auto& t : threads) t.join();
+    for (int sock : socks) close(sock);
+    if (sw.remaining != 0) return false;
+
+    for (size_t i = 0; i < socks.size(); ++i) std::cerr << "REPLICA_CHUNKS[" << i << "]:" << sw.served[i] << std::endl;
+    for (auto& chunk : sw.chunks) {
+        for (auto& word : chunk) all_words.push_back(std::move(word));
+    }
+    return true;
+}
+
+// Words this client already holds, [start, start + words.size()), served to other
+// clients in peer mode while the download is still running
+struct PeerStore {
+    std::mutex mu;
+    int start = 0;
+    bool eof = false;
+    std::vector<std::string> words;
+};
+
+// Answer "p,k" from the store like the server would, or "MISS" for ranges not held yet
+std::string peer_chunk(PeerStore& store, int p, int k) {
+    std::lock_guard<std::mutex> lock(store.mu);
+    int end = store.start + static_cast<int>(store.words.size());
+    if (p < store.start || k <= 0) return "MISS\n";
+    if (p >= end) return store.eof ? "EOF\n" : "MISS\n";
+    if (p + k > end && !store.eof) return "MISS\n";
+    std::string response;
+    for (int i = p; i < p + k; ++i) {
+        if (i >= end) { response += ",EOF"; break; }
+        if (i > p) response += ",";
+        response += store.words[i - store.start];
+    }
+    return response + "\n";
+}
+
+void peer_serve_conn(PeerStore& store, int sock) {
+    std::string inbuf, line;
+    while (read_line(sock, inbuf, line)) {
+        size_t comma = line.find(',');
+        std::string response = "MISS\n";
+        try {
+            if (comma != std::string::npos) response = peer_chunk(store, std::stoi(line.substr(0, comma)), std::stoi(line.substr(comma + 1)));
+        } catch (const std::exception& e) {}
+        if (sock_send(sock, response.c_str(), response.length(), MSG_NOSIGNAL) <= 0) break;
+    }
+    close(sock);
+}
+
+// Listen for other peers on peer_port; returns false if the port cannot be bound
+bool peer_listen(PeerStore& store, int peer_port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(peer_port);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        close(fd);
+        return false;
+    }
+    std::thread([&store, fd]() {
+        while (true) {
+            int sock = accept(fd, nullptr, nullptr);
+            if (sock < 0) continue;
+            std::thread(peer_serve_conn, std::ref(store), sock).detach();
+        }
+    }).detach();
+    return true;
+}
+
+// Peer-assisted download. The server connection doubles as the tracker: before every
+// span of `span` chunks we ask it for a peer holding that span ("PEER p,n") and fetch
+// from the peer if there is one, falling back to the server on a miss. After each span
+// we advertise what we hold ("HAVE port,start,end") so later clients can use us.
+bool peer_download(int sock, std::string& inbuf, int p, int k, int peer_port, int span, PeerStore& store) {
+    std::map<std::string, std::pair<int, std::string>> peer_conns;  // addr -> socket, read buffer
+    long long from_peers = 0, from_server = 0;
+    int offset = p;
+    bool eof = false;
+    std::string line;
+    store.start = p;
+    while (!eof) {
+        int span_words = span * k;
+        std::string ask = "PEER " + std::to_string(offset) + "," + std::to_string(span_words) + "\n";
+        sock_send(sock, ask.c_str(), ask.length(), 0);
+        if (!read_line(sock, inbuf, line)) return false;
+
+        int done_chunks = 0;
+        if (line.compare(0, 5, "PEER ") == 0) {
+            std::string addr = line.substr(5);
+            auto it = peer_conns.find(addr);
+            if (it == peer_conns.end()) {
+                size_t colon = addr.rfind(':');
+                int psock = connect_to(addr.substr(0, colon), std::stoi(addr.substr(colon + 1)));
+                it = peer_conns.emplace(addr, std::make_pair(psock, std::string())).first;
+            }
+            int psock = it->second.first;
+            std::string requests;
+            for (int i = 0; i < span; ++i) requests += std::to_string(offset + i * k) + "," + std::to_string(k) + "\n";
+            if (psock >= 0 && send(psock, requests.c_str(), requests.length(), MSG_NOSIGNAL) > 0) {
+                // Read every reply to keep the stream in sync, but stop using them after a miss
+                bool miss = false;
+                for (int i = 0; i < span; ++i) {
+                    if (!read_line(psock, it->second.second, line)) { close(psock); it->second.first = -1; break; }
+                    if (miss || eof) continue;
+                    if (line == "MISS") { miss = true; continue; }
+                    std::lock_guard<std::mutex> lock(store.mu);
+                    size_t before = store.words.size();
+                    eof = consume_chunk(line, store.words);
+                    store.eof = eof;
+                    from_peers += store.words.size() - before;
+                    done_chunks++;
+                }
+            }
+        }
+
+        // Whatever the peer did not cover comes from the server
+        offset += done_chunks * k;
+        for (int i = done_chunks; i < span && !eof; ++i) {
+            std::string request = std::to_string(offset) + "," + std::to_string(k) + "\n";
+            sock_send(sock, request.c_str(), request.length(), 0);
+            if (!read_line(sock, inbuf, line)) return false;
+            std::lock_guard<std::mutex> lock(store.mu);
+            size_t before = store.words.size();
+            eof = consume_chunk(line, store.words);
+            store.eof = eof;
+            from_server += store.words.size() - before;
+            offset += k;
+        }
+
+        std::string have = "HAVE " + std::to_string(peer_port) + "," + std::to_string(p) + "," +
+                           std::to_string(eof ? offset + span_words : offset) + "\n";
+        sock_send(sock, have.c_str(), have.length(), 0);
+    }
+    for (auto& pc : peer_conns) if (pc.second.first >= 0) close(pc.second.first);
+    std::cerr << "PEER_WORDS:" << from_peers << " SERVER_WORDS:" << from_server << std::endl;
+    return true;
+}
+
+// Receive the corpus from the server's multicast push, then NACK whatever was lost
+// over the TCP connection. mcast_if picks the interface to join on; the receive
+// phase ends after idle_ms without a datagram or once every packet has arrived.
+bool multicast_download(int sock, std::string& inbuf, const std::string& iface, int idle_ms,
+                        std::vector<std::string>& all_words) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    int rcvbuf = 8 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    std::string line;
+    sock_send(sock, "SUBSCRIBE\n", 10, 0);
+    if (!read_line(sock, inbuf, line) || line.compare(0, 6, "MCAST ") != 0) {
+        std::cerr << "SUBSCRIBE failed: " << line << std::endl;
+        close(fd);
+        return false;
+    }
+    std::vector<std::string> fields;
+    split(line.substr(6), ',', fields);
+    if (fields.size() != 4) { close(fd); return false; }
+    int mport = std::stoi(fields[1]);
+    size_t total = std::stoul(fields[2]);
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(mport);
+    addr.sin_addr.s_addr = INADDR_ANY;
+    struct ip_mreq mreq = {};
+    inet_pton(AF_INET, fields[0].c_str(), &mreq.imr_multiaddr);
+    mreq.imr_interface.s_addr = INADDR_ANY;
+    if (!iface.empty()) inet_pton(AF_INET, iface.c_str(), &mreq.imr_interface);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("multicast join");
+        close(fd);
+        return false;
+    }
+    struct timeval tv = {idle_ms / 1000, (idle_ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    std::vector<std::string> packets(total);
+    std::vector<char> have(total, 0);
+    size_t received = 0;
+    char dgram[2048];
+    while (received < total) {
+        ssize_t n = recv(fd, dgram, sizeof(dgram), 0);
+        if (n < 0) break;  // idle timeout: repair the rest over TCP
+        if (n < 8) continue;
+        uint32_t seq, count;
+        memcpy(&seq, dgram, 4);
+        memcpy(&count, dgram + 4, 4);
+        seq = ntohl(seq);
+        if (ntohl(count) != total || seq >= total || have[seq]) continue;
+        packets[seq].assign(dgram + 8, n - 8);
+        have[seq] = 1;
+        received++;
+    }
+    close(fd);
+
+    // NACK repair in batches so request lines stay short
+    size_t repaired = 0;
+    std::vector<size_t> missing;
+    for (size_t i = 0; i < total; ++i) if (!have[i]) missing.push_back(i);
+    for (size_t base = 0; base < missing.size(); base += 256) {
+        size_t end = std::min(missing.size(), base + 256);
+        std::string nack = "NACK ";
+        for (size_t i = base; i < end; ++i) nack += (i > base ? "," : "") + std::to_string(missing[i]);
+        nack += "\n";
+        sock_send(sock, nack.c_str(), nack.length(), 0);
+        for (size_t i = base; i < end; ++i) {
+            if (!read_line(sock, inbuf, line)) return false;
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) return false;
+            size_t seq = std::stoul(line.substr(0, colon));
+            if (seq >= total) return false;
+            packets[seq] = line.substr(colon + 1);
+            repaired++;
+        }
+    }
+
+    // Payloads are slices of the comma-joined corpus that may cut a word in two
+    std::string joined;
+    for (const auto& payload : packets) joined += payload;
+    split(joined, ',', all_words);
+    std::cerr << "MCAST_PACKETS:" << received << " REPAIRED:" << repaired << std::endl;
+    return true;
+}
+
+// Blocks and word counts of the corpus as last downloaded, kept between runs for --cache
+struct DeltaCache {
+    std::map<std::string, int> counts;
+    std::map<std::string, std::vector<std::string>> blocks;  // block hash -> words
+    std::vector<std::string> order;                           // block hashes in corpus order
+};
+
+// Cache file: "COUNTS n", n lines of "word,count", then "BLOCK hash" + words line per block
+DeltaCache load_cache(const std::string& path) {
+    DeltaCache cache;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 7, "COUNTS ") == 0) {
+            int n = std::stoi(line.substr(7));
+            for (int i = 0; i < n && std::getline(file, line); ++i) {
+                size_t comma = line.rfind(',');
+                cache.counts[line.substr(0, comma)] = std::stoi(line.substr(comma + 1));
+            }
+        } else if (line.compare(0, 6, "BLOCK ") == 0) {
+            std::string hash = line.substr(6);
+            std::vector<std::string> words;
+            if (std::getline(file, line)) split(line, ',', words);
+            cache.blocks[hash] = words;
+            cache.order.push_back(hash);
+        }
+    }
+    return cache;
+}
+
+void save_cache(const std::string& path, const DeltaCache& cache) {
+    std::ofstream file(path);
+    file << "COUNTS " << cache.counts.size() << "\n";
+    for (const auto& pair : cache.counts) file << pair.first << "," << pair.second << "\n";
+    for (const auto& hash : cache.order) {
+        const auto& words = cache.blocks.at(hash);
+        file << "BLOCK " << hash << "\n";
+        for (size_t i = 0; i < words.size(); ++i) file << (i ? "," : "") << words[i];
+        file << "\n";
+    }
+}
+
+// Fetch the server's block list, download only blocks missing from the cache and
+// adjust the cached counts by the blocks that appeared or disappeared. The cache always
+// covers the whole corpus; for p > 0 the counts of [p, end) are taken from its blocks.
+bool delta_sync(int sock, std::string& inbuf, const std::string& cache_path, int p, std::map<std::string, int>& freq_map) {
+    DeltaCache old_cache = load_cache(cache_path);
+    std::string line;
+    sock_send(sock, "BLOCKS\n", 7, 0);
+    if (!read_line(sock, inbuf, line) || line.compare(0, 7, "BLOCKS ") != 0) return false;
+    int n = std::stoi(line.substr(7));
+
+    DeltaCache cache;
+    std::vector<std::pair<std::string, std::string>> missing;  // hash, "offset,len" request
+    std::vector<uint64_t> offsets;                             // of each block in cache.order
+    for (int i = 0; i < n; ++i) {
+        if (!read_line(sock, inbuf, line)) return false;
+        std::vector<std::string> fields;
+        split(line, ',', fields);
+        if (fields.size() != 3) return false;
+        cache.order.push_back(fields[2]);
+        offsets.push_back(std::stoull(fields[0]));
+        auto it = old_cache.blocks.find(fields[2]);
+        if (it != old_cache.blocks.end()) {
+            cache.blocks[fields[2]] = it->second;
+        } else if (!cache.blocks.count(fields[2])) {
+            cache.blocks[fields[2]] = {};
+            missing.push_back({fields[2], fields[0] + "," + fields[1] + "\n"});
+        }
+    }
+
+    // Pipeline the block requests in windows so neither side stalls on a full socket buffer
+    const size_t window = 64;
+    for (size_t base = 0; base < missing.size(); base += window) {
+        size_t end = std::min(missing.size(), base + window);
+        std::string requests;
+        for (size_t i = base; i < end; ++i) requests += missing[i].second;
+        sock_send(sock, requests.c_str(), requests.length(), 0);
+        for (size_t i = base; i < end; ++i) {
+            if (!read_line(sock, inbuf, line)) return false;
+            consume_chunk(line, cache.blocks[missing[i].first]);
+        }
+    }
+
+    // Incremental recount: apply the change in occurrences of every block hash
+    std::map<std::string, int> delta;
+    for (const auto& hash : old_cache.order) delta[hash]--;
+    for (const auto& hash : cache.order) delta[hash]++;
+    cache.counts = old_cache.counts;
+    for (const auto& pair : delta) {
+        if (pair.second == 0) continue;
+        const auto& words = cache.blocks.count(pair.first) ? cache.blocks[pair.first] : old_cache.blocks[pair.first];
+        for (const auto& word : words) {
+            if (!word.empty() && (cache.counts[word] += pair.second) == 0) cache.counts.erase(word);
+        }
+    }
+
+    std::cerr << "DELTA_BLOCKS:" << missing.size() << "/" << n << std::endl;
+    save_cache(cache_path, cache);
+    freq_map = cache.counts;
+    if (p <= 0) return true;
+    freq_map.clear();
+    for (size_t i = 0; i < cache.order.size(); ++i) {
+        const auto& words = cache.blocks[cache.order[i]];
+        for (size_t j = static_cast<uint64_t>(p) > offsets[i] ? p - offsets[i] : 0; j < words.size(); ++j) {
+            if (!words[j].empty()) freq_map[words[j]]++;
+        }
+    }
+    return true;
+}
+
+// Optional per-request instrumentation (--stats, --stats-json, --stats-csv) for the
+// single-connection modes: connect time, time to first response byte, and the RTT and
+// size of every request (a NEXT batch counts as one request)
+struct RequestStats {
+    using clock = std::chrono::steady_clock;
+    bool enabled = false;
+    clock::time_point t_start, t_connected, t_first_byte, t_sent;
+    bool got_first_byte = false;
+    std::vector<double> rtt_ms;
+    std::vector<size_t> bytes;
+    size_t pending_bytes = 0;
+    std::string tcp = "{}";  // TCP_INFO sampled just before the connection closes
+
+    void begin() { t_start = clock::now(); }
+    void connected() { t_connected = clock::now(); }
+    // Call just before a request is sent: on loopback the reply can be back before send() returns
+    void sending() {
+        t_sent = clock::now();
+        pending_bytes = 0;
+    }
+    // Call right after a request is sent; the first one also waits for the first byte
+    void sent(int sock, const std::string& inbuf) {
+        if (!enabled) return;
+        if (!got_first_byte) {
+            char c;
+            if (inbuf.empty()) recv(sock, &c, 1, MSG_PEEK);
+            t_first_byte = clock::now();
+            got_first_byte = true;
+        }
+    }
+    void line(const std::string& response) { pending_bytes += response.size() + 1; }
+    void done() {
+        if (!enabled) return;
+        rtt_ms.push_back(std::chrono::duration<double, std::milli>(clock::now() - t_sent).count());
+        bytes.push_back(pending_bytes);
+    }
+};
+
+double percentile(std::vector<double> v, double q) {
+    if (v.empty()) return 0;
+    size_t idx = std::min(v.size() - 1, static_cast<size_t>(q * v.size()));
+    std::nth_element(v.begin(), v.begin() + idx, v.end());
+    return v[idx];
+}
+
+void print_stats(const RequestStats& st, double elapsed_ms, bool json, const std::string& csv_path) {
+    auto ms = [](RequestStats::clock::time_point a, RequestStats::clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    double connect_ms = ms(st.t_start, st.t_connected);
+    double ttfb_ms = st.got_first_byte ? ms(st.t_connected, st.t_first_byte) : 0;
+    size_t total_bytes = 0;
+    for (size_t b : st.bytes) total_bytes += b;
+    double mean_bytes = st.bytes.empty() ? 0 : static_cast<double>(total_bytes) / st.bytes.size();
+    double mbps = elapsed_ms > 0 ? total_bytes * 8 / 1000.0 / elapsed_ms : 0;
+    double p50 = percentile(st.rtt_ms, 0.5), p90 = percentile(st.rtt_ms, 0.9), p99 = percentile(st.rtt_ms, 0.99);
+    double max = percentile(st.rtt_ms, 1.0);
+    char out[512];
+    if (json) {
+        snprintf(out, sizeof(out),
+                 "{\"connect_ms\":%.3f,\"ttfb_ms\":%.3f,\"requests\":%zu,\"rtt_ms\":{\"p50\":%.3f,\"p90\":%.3f,"
+                 "\"p99\":%.3f,\"max\":%.3f},\"bytes\":%zu,\"bytes_per_request\":%.1f,\"throughput_mbps\":%.3f,\"tcp\":",
+                 connect_ms, ttfb_ms, st.rtt_ms.size(), p50, p90, p99, max, total_bytes, mean_bytes, mbps);
+        std::cout << "STATS_JSON:" << out << st.tcp << "}" << std::endl;
+    } else {
+        snprintf(out, sizeof(out),
+                 "CONNECT_MS:%.3f TTFB_MS:%.3f\nREQUESTS:%zu RTT_MS p50:%.3f p90:%.3f p99:%.3f max:%.3f\n"
+                 "BYTES:%zu BYTES_PER_REQUEST:%.1f THROUGHPUT_MBPS:%.3f",
+                 connect_ms, ttfb_ms, st.rtt_ms.size(), p50, p90, p99, max, total_bytes, mean_bytes, mbps);
+        std::cout << out << "\nTCP_INFO:" << st.tcp << std::endl;
+    }
+    if (!csv_path.empty()) {
+        std::ofstream csv(csv_path);
+        csv << "request,rtt_ms,bytes\n";
+        for (size_t i = 0; i < st.rtt_ms.size(); ++i) csv << i << "," << st.rtt_ms[i] << "," << st.bytes[i] << "\n";
+    }
+}
+
 
 int main(int argc, char* argv[]) {
     std::string config_path = "config.json";
     int k_override = -1;
     bool quiet = false;
+    bool use_cursor = false;
+    int batch = 1;
+    std::string cache_path;
+    std::string replica_list;
+    int peer_port = 0;
+    int peer_linger_ms = 0;
+    bool use_multicast = false;
+    bool remote_count = false;
+    bool use_tls = false;
+    bool stats_json = false;
+    std::string stats_csv;
+    std::string weight;
+    std::string mode;
+    std::string fold_case;
+    bool trim = false;
+    RequestStats stats;
     
     for (int i = 1; i < argc; ++i) {
         if (std::string(argv[i]) == "--config" && i + 1 < argc) {
@@ -66,6 +806,39 @@ int main(int argc, char* argv[]) {
             k_override = std::stoi(argv[i + 1]);
         } else if (std::string(argv[i]) == "--quiet") {
             quiet = true;
+        } else if (std::string(argv[i]) == "--cursor") {
+            use_cursor = true;
+        } else if (std::string(argv[i]) == "--weight" && i + 1 < argc) {
+            weight = argv[i + 1];
+        } else if (std::string(argv[i]) == "--stats") {
+            stats.enabled = true;
+        } else if (std::string(argv[i]) == "--stats-json") {
+            stats.enabled = stats_json = true;
+        } else if (std::string(argv[i]) == "--stats-csv" && i + 1 < argc) {
+            stats.enabled = true;
+            stats_csv = argv[i + 1];
+        } else if (std::string(argv[i]) == "--mode" && i + 1 < argc) {
+            mode = argv[i + 1];
+        } else if (std::string(argv[i]) == "--fold" && i + 1 < argc) {
+            fold_case = argv[i + 1];
+        } else if (std::string(argv[i]) == "--trim") {
+            trim = true;
+        } else if (std::string(argv[i]) == "--tls") {
+            use_tls = true;
+        } else if (std::string(argv[i]) == "--remote-count") {
+            remote_count = true;
+        } else if (std::string(argv[i]) == "--multicast") {
+            use_multicast = true;
+        } else if (std::string(argv[i]) == "--peer-port" && i + 1 < argc) {
+            peer_port = std::stoi(argv[i + 1]);
+        } else if (std::string(argv[i]) == "--peer-linger" && i + 1 < argc) {
+            peer_linger_ms = std::stoi(argv[i + 1]);
+        } else if (std::string(argv[i]) == "--replicas" && i + 1 < argc) {
+            replica_list = argv[i + 1];
+        } else if (std::string(argv[i]) == "--cache" && i + 1 < argc) {
+            cache_path = argv[i + 1];
+        } else if (std::string(argv[i]) == "--batch" && i + 1 < argc) {
+            batch = std::max(1, std::stoi(argv[i + 1]));
         }
     }
     
@@ -79,56 +852,213 @@ int main(int argc, char* argv[]) {
     int k = (k_override != -1) ? k_override : (env_k ? std::stoi(env_k) : std::stoi(config["k"]));
     int p = env_p ? std::stoi(env_p) : std::stoi(config["p"]);
 
+    // Counting normalization: "delimiters", "trim" (or --trim), "fold_case" (or --fold)
+    WordNorm norm;
+    const std::string& delimiters = config["delimiters"];
+    for (size_t i = 0; i < delimiters.size(); ++i) {
+        char c = delimiters[i];
+        if (c == '\\' && i + 1 < delimiters.size()) {
+            char e = delimiters[++i];
+            c = e == 'n' ? '\n' : e == 't' ? '\t' : e == 'r' ? '\r' : e;
+        }
+        if (c != ',') norm.delim[static_cast<unsigned char>(c)] = norm.split = true;
+    }
+    norm.trim = trim || (config.count("trim") && config["trim"] != "false" && config["trim"] != "0");
+    if (fold_case.empty()) fold_case = config["fold_case"];
+    if (fold_case == "ascii") norm.fold = WordNorm::Ascii;
+    else if (fold_case == "unicode") norm.fold = WordNorm::Unicode;
+    else if (!fold_case.empty() && fold_case != "none") {
+        std::cerr << "Unknown fold_case " << fold_case << std::endl;
+        return 1;
+    }
+
+    // "replicas": "ip:port,ip:port,..." switches to a multi-source download
+    if (replica_list.empty() && config.count("replicas")) replica_list = config["replicas"];
+    std::vector<std::pair<std::string, int>> replicas;
+    std::vector<std::string> replica_tokens;
+    split(replica_list, ',', replica_tokens);
+    for (const auto& r : replica_tokens) {
+        size_t colon = r.rfind(':');
+        if (colon == std::string::npos) replicas.push_back({r, port});
+        else replicas.push_back({r.substr(0, colon), std::stoi(r.substr(colon + 1))});
+    }
+
     auto start_time = std::chrono::high_resolution_clock::now();
+    stats.begin();
     
-    // Persistent Connection Logic
-    int sock = 0;
-    struct sockaddr_in serv_addr;
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) { return -1; }
-    
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(port);
-    
-    if (inet_pton(AF_INET, server_ip.c_str(), &serv_addr.sin_addr) <= 0) { return -1; }
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) { return -1; }
+    // Persistent Connection Logic (the swarm opens its own connection per replica)
+    int sock = -1;
+    if (replicas.empty() && (sock = connect_to(server_ip, port, config["congestion"])) < 0) { return -1; }
+    stats.connected();
+
+    // TLS on the main connection: --tls or "tls", verified against "tls_ca" when given,
+    // for the name "tls_name" (default: server_ip)
+    if (sock >= 0 && (use_tls || config["tls"] == "1" || config["tls"] == "true")) {
+#ifdef WORD_TLS
+        if (!tls_connect(sock, config["tls_ca"], config.count("tls_name") ? config["tls_name"] : server_ip)) {
+            std::cerr << "TLS handshake failed" << std::endl;
+            close(sock);
+            return -1;
+        }
+#else
+        std::cerr << "Error: --tls needs a build with make TLS=1" << std::endl;
+        close(sock);
+        return -1;
+#endif
+    }
+
+    // Relative share of the server's pacing rate ("weight" or --weight)
+    if (weight.empty() && config.count("weight")) weight = config["weight"];
+    if (sock >= 0 && !weight.empty()) {
+        std::string weight_req = "WEIGHT " + weight + "\n";
+        sock_send(sock, weight_req.c_str(), weight_req.length(), 0);
+    }
 
     std::vector<std::string> all_words;
+    std::string inbuf, response;
+
+    // Response encoding ("mode" or --mode): text, binary, or ids (dictionary fetched once)
+    if (mode.empty()) mode = config.count("mode") ? config["mode"] : "text";
+    // Only the plain and cursor downloads decode frames; the other paths parse text lines
+    bool framed = replicas.empty() && !remote_count && !use_multicast && peer_port <= 0 && cache_path.empty();
+    if (mode != "text" && !framed) {
+        std::cerr << "Error: mode " << mode << " only applies to plain and --cursor downloads" << std::endl;
+        if (sock >= 0) close(sock);
+        return -1;
+    }
+    std::vector<std::string> dict;
+    if (sock >= 0 && mode != "text") {
+        std::string mode_req = "MODE " + mode + "\n" + (mode == "ids" ? "DICT\n" : "");
+        sock_send(sock, mode_req.c_str(), mode_req.length(), 0);
+        if (!read_line(sock, inbuf, response) || response != "OK " + mode ||
+            (mode == "ids" && !read_line(sock, inbuf, response))) {
+            std::cerr << "MODE failed: " << response << std::endl;
+            close(sock);
+            return -1;
+        }
+        if (mode == "ids") split(response, ',', dict);
+    }
+    // One chunk reply in the selected mode; eof is set once it carries EOF
+    auto read_chunk = [&](bool& eof) {
+        if (mode == "text") {
+            if (!read_line(sock, inbuf, response)) return false;
+            stats.line(response);
+            eof = consume_chunk(response, all_words);
+            return true;
+        }
+        size_t frame_bytes = 0;
+        if (!read_frame(sock, inbuf, mode == "ids" ? &dict : nullptr, all_words, eof, frame_bytes)) return false;
+        stats.pending_bytes += frame_bytes;
+        return true;
+    };
     int current_offset = p;
     bool download_complete = false;
+    std::map<std::string, int> freq_map;
+    bool have_counts = false;
+
+    if (!replicas.empty()) {
+        // "replica_timeout_ms": how long a replica may leave a request unanswered
+        int timeout_ms = config.count("replica_timeout_ms") ? std::stoi(config["replica_timeout_ms"]) : 5000;
+        if (!swarm_download(replicas, p, k, timeout_ms, all_words)) {
+            std::cerr << "Swarm download failed" << std::endl;
+            return -1;
+        }
+        download_complete = true;
+    } else if (remote_count) {
+        // Let the server count [p, end) and return "word:count,..." in one line
+        std::string request = "COUNT " + std::to_string(p) + ",2147483647\n";
+        sock_send(sock, request.c_str(), request.length(), 0);
+        if (!read_line(sock, inbuf, response)) {
+            close(sock);
+            return -1;
+        }
+        std::vector<std::string> pairs;
+        split(response, ',', pairs);
+        for (const auto& pair : pairs) {
+            size_t colon = pair.rfind(':');
+            if (colon != std::string::npos) freq_map[pair.substr(0, colon)] = std::stoi(pair.substr(colon + 1));
+        }
+        download_complete = have_counts = true;
+    } else if (use_multicast) {
+        int idle_ms = config.count("mcast_idle_ms") ? std::stoi(config["mcast_idle_ms"]) : 500;
+        if (!multicast_download(sock, inbuf, config["mcast_if"], idle_ms, all_words)) {
+            close(sock);
+            return -1;
+        }
+        download_complete = true;
+    } else if (peer_port > 0) {
+        // Peer mode: stay reachable for peer_linger_ms after finishing so others can use us
+        static PeerStore store;
+        int span = config.count("peer_span") ? std::stoi(config["peer_span"]) : 64;
+        if (!peer_listen(store, peer_port)) {
+            std::cerr << "Cannot listen on peer port " << peer_port << std::endl;
+            close(sock);
+            return -1;
+        }
+        if (!peer_download(sock, inbuf, p, k, peer_port, span, store)) {
+            std::cerr << "Peer download failed" << std::endl;
+            close(sock);
+            return -1;
+        }
+        if (peer_linger_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(peer_linger_ms));
+        std::lock_guard<std::mutex> lock(store.mu);
+        all_words = store.words;
+        download_complete = true;
+    } else if (!cache_path.empty()) {
+        // Delta sync replaces the full download; counts come back already aggregated
+        if (!delta_sync(sock, inbuf, cache_path, p, freq_map)) {
+            std::cerr << "Delta sync failed" << std::endl;
+            close(sock);
+            return -1;
+        }
+        download_complete = have_counts = true;
+    } else if (use_cursor) {
+        // Server-side cursor: one OPEN, then tiny NEXT requests for `batch` chunks each
+        std::string open_req = "OPEN " + std::to_string(p) + "," + std::to_string(k) + "\n";
+        sock_send(sock, open_req.c_str(), open_req.length(), 0);
+        if (!read_line(sock, inbuf, response) || response.compare(0, 3, "OK ") != 0) {
+            std::cerr << "OPEN failed: " << response << std::endl;
+            close(sock);
+            return -1;
+        }
+        std::string next_req = "NEXT " + std::to_string(batch) + "\n";
+        while (!download_complete) {
+            stats.sending();
+            sock_send(sock, next_req.c_str(), next_req.length(), 0);
+            stats.sent(sock, inbuf);
+            for (int i = 0; i < batch && !download_complete; ++i) {
+                if (!read_chunk(download_complete)) { download_complete = true; break; }
+            }
+            stats.done();
+        }
+    }
 
     while (!download_complete) {
         std::string request = std::to_string(current_offset) + "," + std::to_string(k) + "\n";
-        send(sock, request.c_str(), request.length(), 0);
-        
-        char buffer[4096] = {0};
-        ssize_t bytes_read = read(sock, buffer, 4095);
-        
-        if (bytes_read <= 0) {
-            break; 
-        }
-        
-        std::string response(buffer, bytes_read);
-        if (!response.empty() && response.back() == '\n') response.pop_back();
-
-        if (response.find("EOF") != std::string::npos) {
-            download_complete = true;
-            std::string final_part = response.substr(0, response.find("EOF"));
-            if (!final_part.empty() && final_part.back() == ',') final_part.pop_back();
-            if (!final_part.empty()) split(final_part, ',', all_words);
-        } else {
-            split(response, ',', all_words);
-            current_offset += k;
+        stats.sending();
+        sock_send(sock, request.c_str(), request.length(), 0);
+        stats.sent(sock, inbuf);
+
+        if (!read_chunk(download_complete)) {
+            break;
         }
+        stats.done();
+        current_offset += k;
     }
-    close(sock); // Close the single, persistent connection
+    if (sock >= 0 && stats.enabled) stats.tcp = tcp_info_json(sock);
+    if (sock >= 0) close(sock); // Close the single, persistent connection
     
     auto end_time = std::chrono::high_resolution_clock::now();
     auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
     
     if (!quiet) {
-        std::map<std::string, int> freq_map;
-        for (const auto& word : all_words) {
-            if(!word.empty()) freq_map[word]++;
+        if (!have_counts && norm.active()) {
+            std::string scratch;
+            for (const auto& word : all_words) count_normalized(word, norm, freq_map, scratch);
+        } else if (!have_counts) {
+            for (const auto& word : all_words) {
+                if(!word.empty()) freq_map[word]++;
+            }
         }
         for (const auto& pair : freq_map) {
             std::cout << pair.first << "," << pair.second << std::endl;
@@ -136,6 +1066,9 @@ int main(int argc, char* argv[]) {
     }
     
     std::cout << "ELAPSED_MS:" << elapsed_ms << std::endl;
+    if (stats.enabled) {
+        print_stats(stats, std::chrono::duration<double, std::milli>(end_time - start_time).count(), stats_json, stats_csv);
+    }
     
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# Fit T(k) = a + b * R(k) to completion times, where R(k) = floor(N/k) + 1 is the
+# number of requests for an N-word corpus (the +1 is the request that returns EOF).
+#   b = per-request cost = server/client overhead + one RTT (when not pipelined)
+#   a = fixed cost      = connect + total_bytes / bandwidth + startup
+# Reports both with 95% confidence intervals, splits them further when the RTT and
+# bandwidth of the calibration link are given, and recommends k and a pipeline window
+# for a target link.
+#
+#   python3 fit_model.py results.csv --rtt 0.1 --bw 100 --target-rtt 40 --target-bw 1000
+import argparse
+import csv
+import json
+import math
+from collections import defaultdict
+from pathlib import Path
+
+# Two-sided 95% t critical values by degrees of freedom
+T95 = [12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+       2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+       2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042]
+
+
+def t95(df):
+    return T95[df - 1] if 1 <= df <= len(T95) else 1.96
+
+
+def corpus_size(config_path):
+    cfg = json.loads(Path(config_path).read_text())
+    text = Path(cfg["filename"]).read_text().strip()
+    return len(text.split(",")), len(text.encode())
+
+
+def requests_for(n_words, k):
+    return n_words // k + 1
+
+
+def fit(points, n_words):
+    # Ordinary least squares on x = R(k); returns (a, b, se_a, se_b, residual sd)
+    xs = [requests_for(n_words, k) for k, _ in points]
+    ys = [t for _, t in points]
+    n = len(xs)
+    mx, my = sum(xs) / n, sum(ys) / n
+    sxx = sum((x - mx) ** 2 for x in xs)
+    if n < 3 or sxx == 0:
+        raise ValueError("need at least 3 runs over 2 or more distinct k values")
+    b = sum((x - mx) * (y - my) for x, y in zip(xs, ys)) / sxx
+    a = my - b * mx
+    sse = sum((y - a - b * x) ** 2 for x, y in zip(xs, ys))
+    s = math.sqrt(sse / (n - 2))
+    se_b = s / math.sqrt(sxx)
+    se_a = s * math.sqrt(1 / n + mx * mx / sxx)
+    return a, b, se_a, se_b, s, n - 2
+
+
+def recommend(a, b, n_words, n_bytes, rtt_ms, bw_mbit, overhead_ms, tolerance):
+    # Smallest k whose predicted time is within `tolerance` of a single huge request;
+    # larger k only buys memory and head-of-line blocking past that point
+    best_t = a + b
+    k = 1
+    while a + b * requests_for(n_words, k) > best_t * (1 + tolerance) and k < n_words:
+        k = min(n_words, max(k + 1, int(k * 1.1)))
+    # Pipeline window: enough requests in flight to cover one RTT at line rate
+    bytes_per_req = n_bytes / max(1, requests_for(n_words, k))
+    service_ms = overhead_ms + (bytes_per_req * 8 / (bw_mbit * 1000) if bw_mbit else 0)
+    window = max(1, math.ceil((rtt_ms + service_ms) / max(service_ms, 1e-3)))
+    return k, min(window, requests_for(n_words, k))
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Fit the per-request cost model and recommend k")
+    ap.add_argument("results", nargs="?", default="results.csv")
+    ap.add_argument("--config", default="config.json")
+    ap.add_argument("--rtt", type=float, help="RTT of the calibration link in ms")
+    ap.add_argument("--bw", type=float, help="bandwidth of the calibration link in Mbit/s")
+    ap.add_argument("--target-rtt", type=float, help="RTT of the link to recommend for (ms)")
+    ap.add_argument("--target-bw", type=float, help="bandwidth of the link to recommend for (Mbit/s)")
+    ap.add_argument("--tolerance", type=float, default=0.05)
+    args = ap.parse_args()
+
+    n_words, n_bytes = corpus_size(args.config)
+    # results.csv from run_experiments.py, or sweep_results.csv grouped by link
+    groups = defaultdict(list)
+    with open(args.results, newline="") as f:
+        for row in csv.DictReader(f):
+            key = (float(row.get("rtt_ms", args.rtt or 0)), float(row.get("bw_mbit", args.bw or 0)))
+            groups[key].append((int(row["k"]), float(row["elapsed_ms"])))
+
+    for (rtt, bw), points in sorted(groups.items()):
+        a, b, se_a, se_b, s, df = fit(points, n_words)
+        t = t95(df)
+        print(f"== link rtt={rtt}ms bw={bw}Mbit: {len(points)} runs, N={n_words} words, {n_bytes} bytes")
+        print(f"fixed cost       a = {a:.3f} ms  (95% CI {a - t * se_a:.3f} .. {a + t * se_a:.3f})")
+        print(f"per-request cost b = {b * 1000:.2f} us (95% CI {(b - t * se_b) * 1000:.2f} .. {(b + t * se_b) * 1000:.2f})")
+        print(f"residual sd        = {s:.3f} ms")
+        overhead = b
+        if rtt:
+            overhead = b - rtt
+            print(f"  -> per-request overhead beyond RTT = {overhead * 1000:.2f} us")
+        if bw:
+            wire = n_bytes * 8 / (bw * 1000)
+            print(f"  -> transfer time at {bw} Mbit/s = {wire:.3f} ms, remaining fixed cost = {a - wire:.3f} ms")
+
+        target_rtt = args.target_rtt if args.target_rtt is not None else rtt
+        target_bw = args.target_bw if args.target_bw is not None else bw
+        overhead = max(overhead, 0.0)
+        a_t = a - (n_bytes * 8 / (bw * 1000) if bw else 0) + (n_bytes * 8 / (target_bw * 1000) if target_bw else 0)
+        b_t = overhead + target_rtt
+        k, window = recommend(a_t, b_t, n_words, n_bytes, target_rtt, target_bw, overhead, args.tolerance)
+        print(f"recommendation for rtt={target_rtt}ms bw={target_bw}Mbit: k={k} "
+              f"(predicted {a_t + b_t * requests_for(n_words, k):.2f} ms), pipeline window={window}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,98 @@
+// fold.h
+// Case folding shared by server.cpp (COUNT with "fold_case") and client.cpp (counting
+// with --fold), so both sides fold a word the same way
+#ifndef FOLD_H
+#define FOLD_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Simple (one-to-one) Unicode case folding for Latin, Greek, Cyrillic, Armenian and the
+// fullwidth forms; code points of other scripts are returned unchanged
+inline uint32_t fold_code_point(uint32_t c) {
+    if (c < 0x80) return c - 'A' < 26 ? c + 32 : c;
+    if (c == 0xB5) return 0x3BC;                                                  // micro sign
+    if (c >= 0xC0 && c <= 0xDE) return c == 0xD7 ? c : c + 32;                    // Latin-1
+    if (c >= 0x100 && c <= 0x17F) {                                               // Latin Extended-A
+        if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149) return c;
+        if (c == 0x178) return 0xFF;
+        if (c == 0x17F) return 's';
+        bool odd_upper = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+        return (c % 2 == 1) == odd_upper ? c + 1 : c;
+    }
+    if (c == 0x386) return 0x3AC;                                                 // Greek
+    if (c >= 0x388 && c <= 0x38A) return c + 37;
+    if (c == 0x38C) return 0x3CC;
+    if (c == 0x38E || c == 0x38F) return c + 63;
+    if (c >= 0x391 && c <= 0x3AB) return c == 0x3A2 ? c : c + 32;
+    if (c == 0x3C2) return 0x3C3;                                                 // final sigma
+    if (c >= 0x400 && c <= 0x40F) return c + 80;                                  // Cyrillic
+    if (c >= 0x410 && c <= 0x42F) return c + 32;
+    if (c == 0x4C0) return 0x4CF;
+    if ((c >= 0x460 && c <= 0x481) || (c >= 0x48A && c <= 0x4BF) || (c >= 0x4D0 && c <= 0x52F)) return c % 2 ? c : c + 1;
+    if (c >= 0x4C1 && c <= 0x4CE) return c % 2 ? c + 1 : c;
+    if (c >= 0x531 && c <= 0x556) return c + 48;                                  // Armenian
+    if ((c >= 0x1E00 && c <= 0x1E95) || (c >= 0x1EA0 && c <= 0x1EFF)) return c % 2 ? c : c + 1;
+    if (c == 0x1E9E) return 0xDF;                                                 // capital sharp s
+    if (c == 0x2126) return 0x3C9;                                                // ohm
+    if (c == 0x212A) return 'k';                                                  // kelvin
+    if (c == 0x212B) return 0xE5;                                                 // angstrom
+    if (c >= 0xFF21 && c <= 0xFF3A) return c + 32;                                // fullwidth
+    return c;
+}
+
+// Append w, case-folded, to out. ASCII is lowercased eight bytes at a time; in Unicode
+// mode other sequences are decoded, folded and re-encoded, and malformed bytes are copied.
+inline void fold_word(const char* w, size_t n, bool unicode, std::string& out) {
+    size_t i = 0;
+    const uint64_t ones = 0x0101010101010101ULL;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        memcpy(&v, w + i, 8);
+        if (v & (ones * 0x80)) break;
+        // High bit of each byte: >= 'A', and > 'Z'; no byte carries into the next
+        uint64_t upper = (v + ones * (0x80 - 'A')) & ~(v + ones * (0x7F - 'Z')) & (ones * 0x80);
+        v |= upper >> 2;
+        out.append(reinterpret_cast<const char*>(&v), 8);
+    }
+    while (i < n) {
+        unsigned char c = w[i];
+        if (c < 0x80 || !unicode) {
+            out += static_cast<char>(static_cast<unsigned>(c - 'A') < 26 ? c + 32 : c);
+            ++i;
+            continue;
+        }
+        int len = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        uint32_t cp = c & (0x7F >> len);
+        bool ok = len > 1 && i + len <= n;
+        for (int j = 1; ok && j < len; ++j) {
+            ok = (w[i + j] & 0xC0) == 0x80;
+            cp = cp << 6 | (w[i + j] & 0x3F);
+        }
+        if (!ok) {
+            out += static_cast<char>(c);
+            ++i;
+            continue;
+        }
+        cp = fold_code_point(cp);
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | cp >> 6);
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | cp >> 12);
+            out += static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | cp >> 18);
+            out += static_cast<char>(0x80 | (cp >> 12 & 0x3F));
+            out += static_cast<char>(0x80 | (cp >> 6 & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        i += len;
+    }
+}
+
+#endif
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Mininet-free topology: network namespaces joined by veth pairs to a Linux bridge,
+# shaped with tc netem (delay, loss) and tbf (rate). make_net() returns an object with the
+# same start/get/stop and host cmd/popen calls the experiment scripts already use.
+import json
+import subprocess
+from pathlib import Path
+
+PREFIX = "wc-"
+DEFAULT_TOPO = {
+    "hosts": {"h1": "10.0.0.1/24", "h2": "10.0.0.2/24"},
+    # bw in Mbit/s, delay in ms (each direction), loss in percent
+    "links": {"h1": {"bw": 100}, "h2": {"bw": 100}},
+}
+
+
+def sh(*args, check=True):
+    out = subprocess.run(args, capture_output=True, text=True)
+    if check and out.returncode != 0:
+        raise RuntimeError(f"{' '.join(args)}: {out.stderr.strip()}")
+    return out
+
+
+def shape(ns, dev, link):
+    # netem at the root for delay/loss, tbf underneath it for bandwidth
+    tc = ["ip", "netns", "exec", ns, "tc", "qdisc", "add", "dev", dev]
+    netem = []
+    if link.get("delay"):
+        netem += ["delay", f"{link['delay']}ms"] + ([f"{link['jitter']}ms"] if link.get("jitter") else [])
+    if link.get("loss"):
+        netem += ["loss", f"{link['loss']}%"]
+    parent = ["root"]
+    if netem:
+        sh(*tc, "root", "handle", "1:", "netem", *netem, "limit", str(link.get("limit", 1000)))
+        parent = ["parent", "1:1"]
+    if link.get("bw"):
+        rate_bytes = link["bw"] * 1e6 / 8
+        burst = max(int(rate_bytes / 250), 1600)  # ~4ms of traffic at line rate
+        sh(*tc, *parent, "handle", "2:", "tbf", "rate", f"{link['bw']}mbit",
+           "burst", str(burst), "latency", f"{link.get('queue_ms', 50)}ms")
+
+
+class Host:
+    def __init__(self, name, ip):
+        self.name = name
+        self.ns = PREFIX + name
+        self.ip = ip
+
+    def cmd(self, command):
+        # Like Mininet's Host.cmd: run to completion and return stdout
+        out = subprocess.run(["ip", "netns", "exec", self.ns, "sh", "-c", command],
+                             capture_output=True, text=True)
+        return out.stdout + out.stderr
+
+    def popen(self, command, shell=True, **kwargs):
+        argv = ["ip", "netns", "exec", self.ns] + (["sh", "-c", command] if shell else list(command))
+        return subprocess.Popen(argv, **kwargs)
+
+
+class NetnsNet:
+    def __init__(self, topo):
+        self.topo = topo
+        self.hosts = {name: Host(name, ip.split("/")[0]) for name, ip in topo["hosts"].items()}
+        self.switch_ns = PREFIX + "s1"
+
+    def get(self, name):
+        return self.hosts[name]
+
+    def start(self):
+        self.stop()  # clear leftovers from an interrupted run
+        sh("ip", "netns", "add", self.switch_ns)
+        sh("ip", "netns", "exec", self.switch_ns, "ip", "link", "add", "br0", "type", "bridge")
+        sh("ip", "netns", "exec", self.switch_ns, "ip", "link", "set", "br0", "up")
+        for name, cidr in self.topo["hosts"].items():
+            ns, host_if, sw_if = PREFIX + name, f"{name}-eth0", f"s1-{name}"
+            sh("ip", "netns", "add", ns)
+            sh("ip", "link", "add", host_if, "netns", ns, "type", "veth", "peer", "name", sw_if, "netns", self.switch_ns)
+            sh("ip", "netns", "exec", ns, "ip", "addr", "add", cidr, "dev", host_if)
+            sh("ip", "netns", "exec", ns, "ip", "link", "set", host_if, "up")
+            sh("ip", "netns", "exec", ns, "ip", "link", "set", "lo", "up")
+            sh("ip", "netns", "exec", self.switch_ns, "ip", "link", "set", sw_if, "master", "br0")
+            sh("ip", "netns", "exec", self.switch_ns, "ip", "link", "set", sw_if, "up")
+            # Shape both directions, like a TCLink does on each end
+            link = self.topo.get("links", {}).get(name, {})
+            shape(ns, host_if, link)
+            shape(self.switch_ns, sw_if, link)
+
+    def stop(self):
+        for name in list(self.topo["hosts"]) + ["s1"]:
+            sh("ip", "netns", "del", PREFIX + name, check=False)
+
+
+def load_topo(path=None):
+    if path and Path(path).exists():
+        return json.loads(Path(path).read_text())
+    return DEFAULT_TOPO
+
+
+def make_net(path="topology.json", topo=None):
+    return NetnsNet(topo if topo is not None else load_topo(path))
@@ -0,0 +1,265 @@
+// replay.cpp
+// Re-issue a request trace recorded by the server (trace_file) against a server.
+// Each traced connection gets its own connection, and requests go out at their
+// recorded times divided by --speed (0 sends everything as fast as possible).
+// Sending and receiving run on separate threads per connection, so a slow response
+// does not delay the requests scheduled behind it. Replies are taken as counted
+// frames ("MODE binary", or "MODE ids" when the corpus has longer words), so each
+// one is counted exactly whatever bytes its words hold.
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+// JSON parser
+std::map<std::string, std::string> parse_config(const std::string& filename) {
+    std::map<std::string, std::string> config;
+    std::ifstream file(filename);
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t quote1 = line.find('\"');
+        if (quote1 == std::string::npos) continue;
+        size_t quote2 = line.find('\"', quote1 + 1);
+        if (quote2 == std::string::npos) continue;
+
+        std::string key = line.substr(quote1 + 1, quote2 - quote1 - 1);
+
+        size_t colon = line.find(':', quote2);
+        if (colon == std::string::npos) continue;
+
+        size_t val_start = line.find_first_not_of(" \t,", colon + 1);
+        if (val_start == std::string::npos) continue;
+
+        size_t val_end = line.find_last_not_of(" \t,");
+        std::string value = line.substr(val_start, val_end - val_start + 1);
+
+        if (value.front() == '\"' && value.back() == '\"') {
+            value = value.substr(1, value.length() - 2);
+        }
+        config[key] = value;
+    }
+    return config;
+}
+
+// Must match TraceRecord in server.cpp
+#pragma pack(push, 1)
+struct TraceRecord {
+    uint64_t ts_us;
+    uint32_t conn;
+    int64_t p;
+    int64_t k;
+};
+#pragma pack(pop)
+
+bool load_trace(const std::string& path, std::vector<TraceRecord>& records) {
+    std::ifstream file(path, std::ios::binary);
+    uint32_t header[2];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != 0x43525457 ||
+        header[1] != sizeof(TraceRecord)) {
+        return false;
+    }
+    TraceRecord r;
+    while (file.read(reinterpret_cast<char*>(&r), sizeof(r))) records.push_back(r);
+    return true;
+}
+
+struct ConnStats {
+    long long sent = 0, received = 0, bytes = 0;
+    std::vector<double> latency_us;
+    double max_lag_us = 0;  // how far behind schedule sends fell
+};
+
+int connect_to(const std::string& ip, int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    struct sockaddr_in serv_addr = {};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    int one = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (inet_pton(AF_INET, ip.c_str(), &serv_addr.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+uint32_t get_le(const std::string& buf, size_t at, int bytes) {
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; --i) v = (v << 8) | static_cast<unsigned char>(buf[at + i]);
+    return v;
+}
+
+// Size of the counted frame starting at buf[from], or 0 while it is incomplete.
+// id_bytes is 4 for "MODE ids" and 0 for "MODE binary" (u16 length per word).
+size_t frame_size(const std::string& buf, size_t from, int id_bytes) {
+    if (buf.size() < from + 5) return 0;
+    uint32_t count = get_le(buf, from, 4);
+    size_t at = from + 5;
+    if (id_bytes) at += static_cast<size_t>(count) * id_bytes;
+    else {
+        for (uint32_t i = 0; i < count; ++i) {
+            if (buf.size() < at + 2) return 0;
+            at += 2 + get_le(buf, at, 2);
+        }
+    }
+    return buf.size() >= at ? at - from : 0;
+}
+
+// Switch the connection to counted frames; false if the server takes neither mode
+bool select_framing(int sock, int& id_bytes) {
+    for (const char* mode : {"binary", "ids"}) {
+        std::string req = std::string("MODE ") + mode + "\n", reply;
+        if (send(sock, req.data(), req.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(req.size())) return false;
+        char ch;
+        while (read(sock, &ch, 1) == 1 && ch != '\n') reply += ch;
+        if (reply == std::string("OK ") + mode) {
+            id_bytes = mode[0] == 'i' ? 4 : 0;
+            return true;
+        }
+    }
+    return false;
+}
+
+void replay_conn(const std::string& ip, int port, const std::vector<TraceRecord>& recs, uint64_t t0_us, double speed,
+                 std::chrono::steady_clock::time_point start, ConnStats& st) {
+    int sock = connect_to(ip, port);
+    if (sock < 0) return;
+    int id_bytes = 0;
+    if (!select_framing(sock, id_bytes)) {
+        close(sock);
+        return;
+    }
+    std::mutex mu;
+    std::deque<std::chrono::steady_clock::time_point> in_flight;
+    long long expected = static_cast<long long>(recs.size());  // lowered to st.sent if the sender stops early
+
+    // Every "p,k" request is answered by exactly one frame
+    std::thread reader([&]() {
+        std::vector<char> buf(1 << 16);
+        std::string pending;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mu);
+                if (st.received >= expected) break;
+            }
+            ssize_t n = read(sock, buf.data(), buf.size());
+            if (n <= 0) break;
+            st.bytes += n;
+            pending.append(buf.data(), n);
+            auto now = std::chrono::steady_clock::now();
+            size_t at = 0, len;
+            std::lock_guard<std::mutex> lock(mu);
+            while ((len = frame_size(pending, at, id_bytes)) > 0) {
+                at += len;
+                if (in_flight.empty()) continue;
+                st.latency_us.push_back(std::chrono::duration<double, std::micro>(now - in_flight.front()).count());
+                in_flight.pop_front();
+                st.received++;
+            }
+            pending.erase(0, at);
+        }
+    });
+
+    std::string request;
+    for (const auto& r : recs) {
+        if (speed > 0) {
+            auto due = start + std::chrono::microseconds(static_cast<long long>((r.ts_us - t0_us) / speed));
+            auto now = std::chrono::steady_clock::now();
+            if (due > now) std::this_thread::sleep_until(due);
+            else st.max_lag_us = std::max(st.max_lag_us, std::chrono::duration<double, std::micro>(now - due).count());
+        }
+        request = std::to_string(r.p) + "," + std::to_string(r.k) + "\n";
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            in_flight.push_back(std::chrono::steady_clock::now());
+        }
+        if (send(sock, request.data(), request.size(), MSG_NOSIGNAL) <= 0) break;
+        st.sent++;
+    }
+    if (st.sent < static_cast<long long>(recs.size())) {
+        // Stopped early: wait only for what went out, and half-close so the server
+        // closes too and a reader blocked in read wakes up
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            expected = st.sent;
+            if (in_flight.size() > static_cast<size_t>(st.sent - st.received)) in_flight.pop_back();
+        }
+        shutdown(sock, SHUT_WR);
+    }
+    reader.join();
+    close(sock);
+}
+
+double percentile(std::vector<double>& v, double q) {
+    if (v.empty()) return 0;
+    size_t idx = std::min(v.size() - 1, static_cast<size_t>(q * v.size()));
+    std::nth_element(v.begin(), v.begin() + idx, v.end());
+    return v[idx];
+}
+
+int main(int argc, char* argv[]) {
+    std::string config_path = "config.json";
+    std::string trace_path;
+    double speed = 1.0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--config" && i + 1 < argc) config_path = argv[++i];
+        else if (arg == "--trace" && i + 1 < argc) trace_path = argv[++i];
+        else if (arg == "--speed" && i + 1 < argc) speed = std::stod(argv[++i]);
+    }
+    auto config = parse_config(config_path);
+    if (trace_path.empty()) trace_path = config.count("trace_file") ? config["trace_file"] : "trace.bin";
+
+    std::vector<TraceRecord> records;
+    if (!load_trace(trace_path, records) || records.empty()) {
+        std::cerr << "Error: cannot read trace " << trace_path << std::endl;
+        return 1;
+    }
+    std::map<uint32_t, std::vector<TraceRecord>> by_conn;
+    for (const auto& r : records) by_conn[r.conn].push_back(r);
+    uint64_t t0 = records.front().ts_us;
+
+    std::string server_ip = config["server_ip"];
+    int port = std::stoi(config["server_port"]);
+    std::vector<ConnStats> stats(by_conn.size());
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    size_t i = 0;
+    for (const auto& entry : by_conn) {
+        threads.emplace_back(replay_conn, server_ip, port, std::cref(entry.second), t0, speed, start, std::ref(stats[i++]));
+    }
+    for (auto& t : threads) t.join();
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    long long sent = 0, received = 0, bytes = 0;
+    double max_lag = 0;
+    std::vector<double> lat;
+    for (auto& st : stats) {
+        sent += st.sent;
+        received += st.received;
+        bytes += st.bytes;
+        max_lag = std::max(max_lag, st.max_lag_us);
+        lat.insert(lat.end(), st.latency_us.begin(), st.latency_us.end());
+    }
+    printf("CONNECTIONS:%zu REQUESTS:%zu SENT:%lld RECEIVED:%lld\n", by_conn.size(), records.size(), sent, received);
+    printf("WALL_MS:%.2f REQ_PER_S:%.0f THROUGHPUT_MBPS:%.2f\n", wall_ms, received * 1000.0 / wall_ms,
+           bytes * 8 / 1000.0 / wall_ms);
+    printf("LATENCY_US p50:%.1f p99:%.1f max:%.1f\n", percentile(lat, 0.5), percentile(lat, 0.99), percentile(lat, 1.0));
+    printf("MAX_SCHEDULE_LAG_US:%.1f\n", max_lag);
+    return received == static_cast<long long>(records.size()) ? 0 : 1;
+}
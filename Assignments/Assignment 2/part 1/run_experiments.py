@@ -4,8 +4,14 @@ import re
 import time
 import csv
 import json
+import os
 from pathlib import Path
-from topo_wordcount import make_net
+
+# TOPO=netns runs on plain network namespaces instead of Mininet/OVS
+if os.environ.get("TOPO") == "netns":
+    from netns_topo import make_net
+else:
+    from topo_wordcount import make_net
 
 # Config
 K_VALUES = [1, 2, 5, 10, 20, 50, 100, 200]
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# Sweep RTT, bandwidth and loss on the netns topology and time the client for each k.
+# Example: sudo python3 run_sweep.py --rtt 1 10 50 --bw 10 100 --k 1 10 100
+import argparse
+import csv
+import re
+import time
+from pathlib import Path
+from netns_topo import make_net, load_topo
+
+SERVER_CMD = "./server --config config.json"
+CLIENT_CMD_TMPL = "./client --config config.json --quiet --k {k}"
+RESULTS_CSV = Path("sweep_results.csv")
+
+
+def topo_for(base, rtt_ms, bw, loss):
+    # Two links between client and server, each traversed once per direction,
+    # so every link direction carries a quarter of the RTT
+    topo = {"hosts": base["hosts"], "links": {}}
+    for name in base["hosts"]:
+        topo["links"][name] = {"bw": bw, "delay": rtt_ms / 4, "loss": loss / 2}
+    return topo
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--topology", default="topology.json")
+    ap.add_argument("--rtt", type=float, nargs="+", default=[0])
+    ap.add_argument("--bw", type=float, nargs="+", default=[100])
+    ap.add_argument("--loss", type=float, nargs="+", default=[0])
+    ap.add_argument("--k", type=int, nargs="+", default=[1, 2, 5, 10, 20, 50, 100, 200])
+    ap.add_argument("--runs", type=int, default=5)
+    args = ap.parse_args()
+
+    base = load_topo(args.topology)
+    with RESULTS_CSV.open("w", newline="") as f:
+        csv.writer(f).writerow(["rtt_ms", "bw_mbit", "loss", "k", "run", "elapsed_ms"])
+
+    for rtt in args.rtt:
+        for bw in args.bw:
+            for loss in args.loss:
+                net = make_net(topo=topo_for(base, rtt, bw, loss))
+                net.start()
+                h1, h2 = net.get('h1'), net.get('h2')
+                srv = h2.popen(SERVER_CMD)
+                time.sleep(0.5)
+                try:
+                    for k in args.k:
+                        for r in range(1, args.runs + 1):
+                            out = h1.cmd(CLIENT_CMD_TMPL.format(k=k))
+                            m = re.search(r"ELAPSED_MS:(\d+)", out)
+                            if not m:
+                                print(f"[warn] rtt={rtt} bw={bw} loss={loss} k={k} run={r}: no ELAPSED_MS\n{out}")
+                                continue
+                            with RESULTS_CSV.open("a", newline="") as f:
+                                csv.writer(f).writerow([rtt, bw, loss, k, r, m.group(1)])
+                        print(f"rtt={rtt}ms bw={bw}Mbit loss={loss}% k={k} done")
+                finally:
+                    srv.terminate()
+                    srv.wait()
+                    net.stop()
+
+
+if __name__ == "__main__":
+    main()
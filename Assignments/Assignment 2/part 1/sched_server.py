@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# Runs the C++ server with one of its request schedulers in place of the part 3 FCFS
+# and part 4 round-robin Python servers. It reads the same config.json (server_ip,
+# port, num_clients, c, p, k) and words.txt from the current directory, so the
+# runners and clients need no changes.
+
+import argparse
+import json
+import os
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# Per-request service time (us) and random jitter (us) of the Python servers, so
+# results stay comparable; "service_us"/"service_jitter_us" in config.json override them
+POLICY_DEFAULTS = {
+    'fcfs': (1500, 0),
+    'rr': (15000, 20000),
+}
+
+
+def native_config(config, policy):
+    service_us, jitter_us = POLICY_DEFAULTS[policy]
+    return {
+        'server_port': config['port'],
+        'filename': os.path.abspath(config.get('words_file', 'words.txt')),
+        'scheduler': policy,
+        'service_us': config.get('service_us', service_us),
+        'service_jitter_us': config.get('service_jitter_us', jitter_us),
+        # One worker is plenty for num_clients connections that mostly wait on the scheduler
+        'workers': config.get('workers', 1),
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='C++ scheduling server with a part 3/4 config')
+    parser.add_argument('--policy', choices=sorted(POLICY_DEFAULTS), required=True)
+    parser.add_argument('--config', default='config.json')
+    args = parser.parse_args()
+
+    with open(args.config, 'r') as f:
+        config = json.load(f)
+
+    server = os.path.join(HERE, 'server')
+    if not os.path.exists(server):
+        print(f"ERROR: {server} not built (run make in part 1)")
+        sys.exit(1)
+
+    os.makedirs('logs', exist_ok=True)
+    native_path = os.path.join('logs', 'native_server.json')
+    with open(native_path, 'w') as f:
+        json.dump(native_config(config, args.policy), f, indent=2)
+
+    print(f"Native {args.policy} server on port {config['port']} for {config.get('num_clients', '?')} clients", flush=True)
+    os.execv(server, [server, '--config', native_path])
+
+
+if __name__ == '__main__':
+    main()
@@ -6,9 +6,52 @@
 #include <map>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <linux/tcp.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <exception>
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <cerrno>
+#include <memory>
+#include <unordered_map>
+#include <deque>
+#include <functional>
+#include <cassert>
+#include <cstring>
+#include <new>
+#include <sys/uio.h>
+#include <random>
+#include <set>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <glob.h>
+#include "fold.h"
+#include "tcp_info.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef WORD_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WORD_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif
 
 // JSON parser
 std::map<std::string, std::string> parse_config(const std::string& filename) {
@@ -41,104 +84,2335 @@ std::map<std::string, std::string> parse_config(const std::string& filename) {
     return config;
 }
 
-std::vector<std::string> read_words(const std::string& filename) {
-    std::ifstream file(filename);
-    std::vector<std::string> words;
-    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
-    
-    // String splitting
+// How corpus bytes become words: "delimiters" adds separator bytes to ',' (\n, \t and \r
+// escapes allowed), "trim" strips ASCII whitespace from both ends of each word, and
+// "validate_utf8" refuses to load a corpus that is not valid UTF-8.
+struct Tokenizer {
+    bool delim[256] = {};
+    bool comma_only = true;  // memchr fast path
+    bool trim = false;
+    bool validate = false;
+    std::string settings;    // folded into the corpus version when not the default
+};
+
+Tokenizer make_tokenizer(const std::string& delimiters, bool trim, bool validate) {
+    Tokenizer tok;
+    tok.delim[static_cast<unsigned char>(',')] = true;
+    for (size_t i = 0; i < delimiters.size(); ++i) {
+        char c = delimiters[i];
+        if (c == '\\' && i + 1 < delimiters.size()) {
+            char e = delimiters[++i];
+            c = e == 'n' ? '\n' : e == 't' ? '\t' : e == 'r' ? '\r' : e;
+        }
+        tok.delim[static_cast<unsigned char>(c)] = true;
+        if (c != ',') tok.comma_only = false;
+    }
+    tok.trim = trim;
+    tok.validate = validate;
+    if (!tok.comma_only || trim) {
+        for (int c = 0; c < 256; ++c) {
+            if (tok.delim[c]) tok.settings += static_cast<char>(c);
+        }
+        tok.settings.push_back(trim ? '\1' : '\0');
+    }
+    return tok;
+}
+
+// Append base + (offset past each delimiter in [data, data + n)) to starts
+void index_delims(const Tokenizer& tok, const char* data, size_t n, size_t base, std::vector<size_t>& starts) {
+    if (tok.comma_only) {
+        for (const char* c = data; (c = static_cast<const char*>(memchr(c, ',', data + n - c))); ++c) starts.push_back(base + (c - data) + 1);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (tok.delim[static_cast<unsigned char>(data[i])]) starts.push_back(base + i + 1);
+    }
+}
+
+bool ascii_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Streaming UTF-8 check that rejects overlong forms, surrogates and code points past
+// U+10FFFF. Input may arrive in pieces that split a sequence. Runs of ASCII, the bulk of
+// most corpora, are skipped 16 bytes at a time.
+struct Utf8Check {
+    int need = 0;       // continuation bytes still expected
+    uint32_t cp = 0;
+    uint32_t min = 0;   // smallest code point the current sequence may encode
+    size_t seen = 0;
+    size_t bad = SIZE_MAX;  // offset of the first invalid byte
+
+    void feed(const char* p, size_t n) {
+        for (size_t i = 0; i < n && bad == SIZE_MAX;) {
+            if (need == 0) {
+#ifdef __SSE2__
+                while (i + 16 <= n && _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i))) == 0) i += 16;
+#endif
+                while (i < n && static_cast<unsigned char>(p[i]) < 0x80) ++i;
+                if (i == n) break;
+                unsigned char c = p[i];
+                if (c >= 0xC2 && c <= 0xDF) { need = 1; cp = c & 0x1F; min = 0x80; }
+                else if (c >= 0xE0 && c <= 0xEF) { need = 2; cp = c & 0x0F; min = 0x800; }
+                else if (c >= 0xF0 && c <= 0xF4) { need = 3; cp = c & 0x07; min = 0x10000; }
+                else bad = seen + i;
+                ++i;
+                continue;
+            }
+            unsigned char c = p[i];
+            if ((c & 0xC0) != 0x80) {
+                bad = seen + i;
+                break;
+            }
+            cp = cp << 6 | (c & 0x3F);
+            if (--need == 0 && (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))) bad = seen + i;
+            ++i;
+        }
+        seen += n;
+    }
+
+    // Throws unless everything fed so far was valid and complete
+    void finish(const std::string& path) {
+        if (need > 0 && bad == SIZE_MAX) bad = seen;
+        if (bad != SIZE_MAX) throw std::runtime_error(path + ": invalid UTF-8 at byte " + std::to_string(bad));
+    }
+};
+
+// One file of the corpus, memory-mapped (or inflated) and indexed at load
+struct CorpusShard {
+    std::string path;
+    size_t len = 0;    // bytes holding words
+    size_t words = 0;
+    const char* data = nullptr;
+    std::vector<size_t> starts;  // word i is [starts[i], starts[i + 1] - 1)
+    std::string text;            // inflated contents of a compressed shard
+};
+
+// The words of one file ("filename"), or of every file in a directory or matching a glob
+// taken in name order, as one sequence. prefix holds the word count before each shard,
+// so a global index finds its shard by binary search. Words are views into the mappings,
+// which live as long as the server.
+struct Corpus {
+    std::vector<std::unique_ptr<CorpusShard>> shards;
+    std::vector<size_t> prefix{0};  // prefix[i]: words before shard i; back(): total
+    uint64_t version = 0;            // FNV-1a over the words, each followed by ','
+    size_t longest = 0;              // bytes in the longest word
+    Tokenizer tok;
+
+    size_t size() const { return prefix.back(); }
+    std::string_view operator[](size_t i) const;
+    size_t shard_of(size_t i) const;
+    std::string_view word(const CorpusShard& sh, size_t local) const;
+};
+
+// Shard holding word i (i < size())
+size_t Corpus::shard_of(size_t i) const {
+    return shards.size() == 1 ? 0 : std::upper_bound(prefix.begin(), prefix.end(), i) - prefix.begin() - 1;
+}
+
+std::string_view Corpus::operator[](size_t i) const {
+    size_t s = shard_of(i);
+    return word(*shards[s], i - prefix[s]);
+}
+
+std::string_view Corpus::word(const CorpusShard& sh, size_t local) const {
+    const char* a = sh.data + sh.starts[local];
+    const char* b = sh.data + sh.starts[local + 1] - 1;
+    if (tok.trim) {
+        while (a < b && ascii_space(*a)) ++a;
+        while (b > a && ascii_space(b[-1])) --b;
+    }
+    return std::string_view(a, b - a);
+}
+
+// Consecutive words from index i on: the shard is found once, and the walk steps to the
+// next shard at its end, so a run of words costs no search per word
+struct CorpusWalk {
+    const Corpus& corpus;
+    size_t shard, local;
+
+    CorpusWalk(const Corpus& c, size_t i) : corpus(c), shard(c.shard_of(i)), local(i - c.prefix[shard]) {}
+
+    // The current word, then advance; at most size() - i calls
+    std::string_view next() {
+        while (local == corpus.shards[shard]->words) {
+            ++shard;
+            local = 0;
+        }
+        return corpus.word(*corpus.shards[shard], local++);
+    }
+};
+
+// Corpus files named by spec: a directory, a glob pattern or a single file
+std::vector<std::string> corpus_files(const std::string& spec) {
+    std::vector<std::string> files;
+    struct stat st;
+    if (stat(spec.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        DIR* dir = opendir(spec.c_str());
+        if (!dir) throw std::runtime_error("cannot open " + spec);
+        while (struct dirent* e = readdir(dir)) {
+            std::string path = spec + "/" + e->d_name;
+            if (e->d_name[0] != '.' && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) files.push_back(path);
+        }
+        closedir(dir);
+        std::sort(files.begin(), files.end());
+    } else if (spec.find_first_of("*?[") != std::string::npos) {
+        glob_t g;
+        if (glob(spec.c_str(), 0, nullptr, &g) == 0) files.assign(g.gl_pathv, g.gl_pathv + g.gl_pathc);  // sorted
+        globfree(&g);
+    } else {
+        files.push_back(spec);
+    }
+    if (files.empty()) throw std::runtime_error("no corpus files match " + spec);
+    return files;
+}
+
+// Drop one trailing newline (or CRLF) from a file's len bytes: it ends the file, not the
+// last word, and a word ending in '\n' would break the line-framed text replies
+size_t trim_newline(size_t len, const char* tail) {
+    if (len > 0 && tail[len - 1] == '\n') return len - ((len > 1 && tail[len - 2] == '\r') ? 2 : 1);
+    return len;
+}
+
+// Inflate a gzip shard (one or more members) into sh.text. Word starts are indexed from
+// each inflated piece as it arrives, so the text is not scanned again to tokenize it.
+void inflate_shard(CorpusShard& sh, const Tokenizer& tok, bool sharded) {
+#ifdef WORD_ZLIB
+    gzFile gz = gzopen(sh.path.c_str(), "rb");
+    if (!gz) throw std::runtime_error("cannot read " + sh.path);
+    gzbuffer(gz, 1 << 17);
+    struct stat st;
+    if (stat(sh.path.c_str(), &st) == 0) sh.text.reserve(st.st_size * 4);
+    sh.starts.push_back(0);
+    const size_t piece = 1 << 20;
+    size_t off = 0;
+    Utf8Check utf8;
+    while (true) {
+        sh.text.resize(off + piece);
+        int n = gzread(gz, &sh.text[off], piece);
+        // A truncated stream reads as a short end of file, with the error left in the state
+        int err = Z_OK;
+        const char* what = n <= 0 ? gzerror(gz, &err) : nullptr;
+        if (n < 0 || err != Z_OK) {
+            std::string message = what;  // gzerror's message already names the file
+            gzclose(gz);
+            throw std::runtime_error(message);
+        }
+        index_delims(tok, &sh.text[off], n, off, sh.starts);
+        if (tok.validate) utf8.feed(&sh.text[off], n);
+        off += n;
+        if (n == 0) break;
+    }
+    gzclose(gz);
+    if (tok.validate) utf8.finish(sh.path);
+    sh.text.resize(off);
+    sh.text.shrink_to_fit();
+    sh.len = trim_newline(off, sh.text.data());
+    // Only [0, len) holds words: drop starts past a trimmed newline that was itself a delimiter
+    while (sh.starts.size() > 1 && sh.starts.back() > sh.len) sh.starts.pop_back();
+    sh.data = sh.text.data();
+    sh.words = sh.len > 0 || !sharded ? sh.starts.size() : 0;
+    sh.starts.push_back(sh.len + 1);
+#else
+    (void)tok;
+    (void)sharded;
+    throw std::runtime_error(sh.path + " is gzip-compressed; build the server with make ZLIB=1");
+#endif
+}
+
+// Map a plain shard and index its words, at load. Shards are not mapped lazily: the word
+// counts behind the prefix index and the version hash read every byte anyway, and doing
+// it all here makes a missing or bad shard fail at startup rather than mid-request. The
+// mapping is read-only and file-backed, so the kernel can still drop its pages under
+// memory pressure and read them back when the words are served.
+void map_shard(CorpusShard& sh, const Tokenizer& tok, bool sharded) {
+    int fd = open(sh.path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("cannot read " + sh.path);
+    }
+    sh.len = st.st_size;
+    sh.data = "";
+    if (sh.len > 0) {
+        void* addr = mmap(nullptr, sh.len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("cannot map " + sh.path);
+        }
+        sh.data = static_cast<const char*>(addr);
+    }
+    close(fd);
+    sh.len = trim_newline(sh.len, sh.data);
+    sh.starts.push_back(0);
+    index_delims(tok, sh.data, sh.len, 0, sh.starts);
+    sh.words = sh.len > 0 || !sharded ? sh.starts.size() : 0;
+    sh.starts.push_back(sh.len + 1);
+    if (tok.validate) {
+        Utf8Check utf8;
+        utf8.feed(sh.data, sh.len);
+        utf8.finish(sh.path);
+    }
+}
+
+bool is_gzip(const std::string& path) {
+    unsigned char magic[2] = {0, 0};
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool gz = pread(fd, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    close(fd);
+    return gz;
+}
+
+// Map or inflate every shard, index its words and hash the corpus. Everything that can
+// fail (a missing, unreadable or corrupt shard, invalid UTF-8) fails here, at startup,
+// never while a request is being served. Compressed shards are inflated several at a
+// time: a deflate stream only decodes from its start, so shards are the unit of
+// parallelism. Every file drops a trailing newline; shards also contribute no words
+// when empty, so newline-terminated files join cleanly.
+Corpus load_corpus(const std::string& spec, const Tokenizer& tok) {
+    Corpus corpus;
+    corpus.tok = tok;
+    std::vector<std::string> files = corpus_files(spec);
+    bool sharded = files.size() > 1 || files[0] != spec;
+    std::vector<CorpusShard*> compressed;
+    for (const auto& path : files) {
+        corpus.shards.push_back(std::make_unique<CorpusShard>());
+        corpus.shards.back()->path = path;
+        if (is_gzip(path)) compressed.push_back(corpus.shards.back().get());
+    }
+
+    std::atomic<size_t> next{0};
+    std::exception_ptr error;
+    std::mutex error_mu;
+    auto inflate_some = [&] {
+        for (size_t i; (i = next++) < compressed.size();) {
+            CorpusShard& sh = *compressed[i];
+            try {
+                inflate_shard(sh, tok, sharded);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mu);
+                if (!error) error = std::current_exception();
+            }
+        }
+    };
+    std::vector<std::thread> inflaters;
+    size_t threads = std::min<size_t>(compressed.size(), std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t t = 1; t < threads; ++t) inflaters.emplace_back(inflate_some);
+    inflate_some();
+    for (auto& t : inflaters) t.join();
+    if (error) std::rethrow_exception(error);
+
+    uint64_t h = 1469598103934665603ULL;
+    auto absorb = [&h](const char* data, size_t n) {
+        for (size_t j = 0; j < n; ++j) { h ^= static_cast<unsigned char>(data[j]); h *= 1099511628211ULL; }
+    };
+    for (auto& sh : corpus.shards) {
+        if (!sh->data) map_shard(*sh, tok, sharded);  // not inflated
+        if (sh->words > 0 && corpus.size() > 0) absorb(",", 1);
+        absorb(sh->data, sh->len);
+        corpus.prefix.push_back(corpus.size() + sh->words);
+    }
+    if (corpus.size() > 0) absorb(",", 1);
+    absorb(tok.settings.data(), tok.settings.size());
+    corpus.version = h;
+    if (corpus.size() > 0) {
+        CorpusWalk walk(corpus, 0);
+        for (size_t i = 0; i < corpus.size(); ++i) corpus.longest = std::max(corpus.longest, walk.next().size());
+    }
+    return corpus;
+}
+
+// FNV-1a of a single word
+uint64_t word_hash(std::string_view w, uint64_t h = 1469598103934665603ULL) {
+    for (unsigned char c : w) { h ^= c; h *= 1099511628211ULL; }
+    return h;
+}
+
+// A content-defined block of the corpus: [offset, offset + len) plus its hash
+struct Block {
+    uint64_t offset;
+    uint32_t len;
+    uint64_t hash;
+};
+
+// Cut the corpus into content-defined blocks so an insertion only changes nearby blocks.
+// A boundary falls after any word where the hash of the last four words has the low
+// bits of avg_words clear, bounded to [avg_words / 4, avg_words * 4] words per block.
+std::vector<Block> make_blocks(const Corpus& words, int avg_words) {
+    std::vector<Block> blocks;
+    uint64_t mask = 1;
+    while (static_cast<int>(mask) < avg_words) mask <<= 1;
+    mask -= 1;
+    uint32_t min_len = std::max(1, avg_words / 4), max_len = std::max(1, avg_words * 4);
     size_t start = 0;
-    size_t end = content.find(',');
-    while (end != std::string::npos) {
-        words.push_back(content.substr(start, end - start));
-        start = end + 1;
-        end = content.find(',', start);
+    uint64_t h = 1469598103934665603ULL;
+    if (words.size() == 0) return blocks;
+    CorpusWalk walk(words, 0);
+    std::string_view recent[4];  // the last four words, recent[i % 4] is word i
+    for (size_t i = 0; i < words.size(); ++i) {
+        recent[i % 4] = walk.next();
+        h = word_hash(recent[i % 4], h);
+        h ^= ','; h *= 1099511628211ULL;
+        uint32_t len = static_cast<uint32_t>(i - start + 1);  // at most max_len
+        uint64_t window = 1469598103934665603ULL;
+        for (size_t j = i < 3 ? 0 : i - 3; j <= i; ++j) window = word_hash(recent[j % 4], window);
+        window ^= window >> 29;
+        bool cut = (len >= min_len && (window & mask) == 0) || len >= max_len;
+        if (cut || i + 1 == words.size()) {
+            blocks.push_back({start, len, h});
+            start = i + 1;
+            h = 1469598103934665603ULL;
+        }
+    }
+    return blocks;
+}
+
+// "BLOCKS" -> "BLOCKS n" followed by n lines of "offset,len,hash"
+std::string list_blocks(const std::vector<Block>& blocks) {
+    std::string response = "BLOCKS " + std::to_string(blocks.size()) + "\n";
+    for (const auto& b : blocks) {
+        response += std::to_string(b.offset) + "," + std::to_string(b.len) + "," + std::to_string(b.hash) + "\n";
+    }
+    return response;
+}
+
+// Per-thread caches of I/O blocks in three size classes. A freed block goes onto the
+// freeing thread's list, so a migrated connection needs no handoff, and back to malloc
+// once that list already holds block_cache blocks, which bounds what idle threads keep.
+const size_t kBlockClass[] = {4096, 16384, 65536};
+const int kNumClasses = 3;
+size_t block_cache_limit = 64;
+std::atomic<uint64_t> block_mallocs{0};
+
+struct BlockCache {
+    std::vector<char*> free[kNumClasses];
+    ~BlockCache() {
+        for (auto& list : free) {
+            for (char* b : list) ::operator delete(b);
+        }
+    }
+};
+thread_local BlockCache block_cache;
+
+int block_class(size_t n) {
+    for (int i = 0; i < kNumClasses; ++i) {
+        if (n <= kBlockClass[i]) return i;
+    }
+    return -1;
+}
+
+// A block of at least n bytes; cap receives its real size
+char* block_alloc(size_t n, size_t& cap) {
+    int cls = block_class(n);
+    cap = cls < 0 ? n : kBlockClass[cls];
+    if (cls >= 0 && !block_cache.free[cls].empty()) {
+        char* b = block_cache.free[cls].back();
+        block_cache.free[cls].pop_back();
+        return b;
+    }
+    block_mallocs++;
+    return static_cast<char*>(::operator new(cap));
+}
+
+void block_free(char* b, size_t cap) {
+    int cls = block_class(cap);
+    if (cls >= 0 && kBlockClass[cls] == cap && block_cache.free[cls].size() < block_cache_limit) {
+        block_cache.free[cls].push_back(b);
+        return;
+    }
+    ::operator delete(b);
+}
+
+// Receive buffer: one contiguous pooled block, returned to the pool whenever it drains
+struct InBuf {
+    char* data = nullptr;
+    size_t cap = 0;
+    size_t len = 0;
+
+    InBuf() = default;
+    InBuf(const InBuf&) = delete;
+    InBuf& operator=(const InBuf&) = delete;
+    ~InBuf() { release(); }
+
+    // Make room for at least extra more bytes
+    void reserve(size_t extra) {
+        if (cap - len >= extra) return;
+        size_t new_cap;
+        char* bigger = block_alloc(len + extra, new_cap);
+        if (len) memcpy(bigger, data, len);
+        if (data) block_free(data, cap);
+        data = bigger;
+        cap = new_cap;
+    }
+    void consume(size_t n) {
+        len -= n;
+        if (len == 0) release();
+        else memmove(data, data + n, len);
+    }
+    void release() {
+        if (data) block_free(data, cap);
+        data = nullptr;
+        cap = len = 0;
+    }
+};
+
+// Send queue: a chain of pooled blocks. Responses are appended in place and each
+// block goes back to the pool as soon as it is on the wire.
+struct OutBuf {
+    struct Block {
+        Block* next;
+        size_t cap, head, tail;
+        char* bytes() { return reinterpret_cast<char*>(this + 1); }
+    };
+    Block* first = nullptr;
+    Block* last = nullptr;
+    size_t size = 0;
+
+    OutBuf() = default;
+    OutBuf(const OutBuf&) = delete;
+    OutBuf& operator=(const OutBuf&) = delete;
+    ~OutBuf() { clear(); }
+
+    bool empty() const { return size == 0; }
+    void append(const std::string& str) { append(str.data(), str.size()); }
+    void append(const char* p, size_t n) {
+        size += n;
+        while (n > 0) {
+            if (!last || last->tail == last->cap) {
+                // Blocks double along a chain, so a large response takes few of them
+                size_t want = sizeof(Block) + n;
+                if (last) want = std::max(want, 2 * (sizeof(Block) + last->cap));
+                want = std::min(want, kBlockClass[kNumClasses - 1]);
+                size_t cap;
+                Block* b = reinterpret_cast<Block*>(block_alloc(want, cap));
+                *b = Block{nullptr, cap - sizeof(Block), 0, 0};
+                (last ? last->next : first) = b;
+                last = b;
+            }
+            size_t take = std::min(n, last->cap - last->tail);
+            memcpy(last->bytes() + last->tail, p, take);
+            last->tail += take;
+            p += take;
+            n -= take;
+        }
+    }
+    // Hand up to 16 blocks to the socket in one call; returns what send() would
+    ssize_t send_to(int fd) {
+        struct iovec iov[16];
+        int count = 0;
+        for (Block* b = first; b && count < 16; b = b->next) {
+            iov[count].iov_base = b->bytes() + b->head;
+            iov[count].iov_len = b->tail - b->head;
+            count++;
+        }
+        struct msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n > 0) drop(n);
+        return n;
+    }
+    // Move other's blocks onto the end of this chain without copying them
+    void splice(OutBuf& other) {
+        if (!other.first) return;
+        (last ? last->next : first) = other.first;
+        last = other.last;
+        size += other.size;
+        other.first = other.last = nullptr;
+        other.size = 0;
+    }
+    void drop(size_t n) {
+        size -= n;
+        while (n > 0) {
+            size_t take = std::min(n, first->tail - first->head);
+            first->head += take;
+            n -= take;
+            if (first->head == first->tail) pop_front();
+        }
+    }
+    void pop_front() {
+        Block* b = first;
+        first = b->next;
+        if (!first) last = nullptr;
+        block_free(reinterpret_cast<char*>(b), b->cap + sizeof(Block));
+    }
+    void clear() {
+        while (first) pop_front();
+        size = 0;
+    }
+};
+
+// Conn objects are recycled through a per-thread freelist the same way
+size_t conn_cache_limit = 1024;
+struct ConnCache {
+    std::vector<void*> free;
+    ~ConnCache() {
+        for (void* c : free) ::operator delete(c);
+    }
+};
+thread_local ConnCache conn_cache;
+
+// Response encodings, selected per connection with "MODE <name>". An encoding policy
+// writes one word and the separator between words; a framing policy writes what goes
+// around a chunk. encode_chunk is instantiated once per combination, so the loop that
+// serves a connection has no mode checks, and bounds and separators are settled per
+// chunk instead of per word.
+
+// Text: words joined by commas
+struct TextWords {
+    static constexpr bool needs_word = true;
+    template <typename Out>
+    static void word(Out& out, std::string_view w, const std::vector<uint32_t>&, size_t) {
+        out.append(w.data(), w.size());
+    }
+    template <typename Out>
+    static void sep(Out& out) { out.append(",", 1); }
+};
+
+template <typename Out>
+void put_le(Out& out, uint32_t v, int bytes) {
+    char b[4] = {static_cast<char>(v), static_cast<char>(v >> 8), static_cast<char>(v >> 16), static_cast<char>(v >> 24)};
+    out.append(b, bytes);
+}
+
+// Binary: each word as a little-endian u16 length and its bytes (words up to 65535 bytes)
+struct BinaryWords {
+    static constexpr bool needs_word = true;
+    template <typename Out>
+    static void word(Out& out, std::string_view w, const std::vector<uint32_t>&, size_t) {
+        put_le(out, static_cast<uint32_t>(w.size()), 2);
+        out.append(w.data(), w.size());
+    }
+    template <typename Out>
+    static void sep(Out&) {}
+};
+
+// Dictionary ids: each word as a little-endian u32 index into the DICT reply
+struct IdWords {
+    static constexpr bool needs_word = false;
+    template <typename Out>
+    static void word(Out& out, std::string_view, const std::vector<uint32_t>& ids, size_t i) {
+        put_le(out, ids[i], 4);
+    }
+    template <typename Out>
+    static void sep(Out&) {}
+};
+
+// Line framing: "w1,w2\n", with ",EOF" when the range runs past the end and a bare
+// "EOF\n" when it starts past the end
+struct LineFrame {
+    template <typename Out>
+    static void begin(Out&, uint32_t, bool) {}
+    template <typename Out>
+    static void end(Out& out, uint32_t count, bool eof) {
+        if (!eof) out.append("\n", 1);
+        else if (count) out.append(",EOF\n", 5);
+        else out.append("EOF\n", 4);
+    }
+};
+
+// Counted framing: a little-endian u32 word count and a flags byte (1 = EOF) ahead of the words
+struct CountedFrame {
+    template <typename Out>
+    static void begin(Out& out, uint32_t count, bool eof) {
+        put_le(out, count, 4);
+        out.append(eof ? "\1" : "\0", 1);
+    }
+    template <typename Out>
+    static void end(Out&, uint32_t, bool) {}
+};
+
+// Words [from, to) in encoding Enc, without framing
+template <typename Enc, typename Out>
+void encode_words(Out& out, const Corpus& words, const std::vector<uint32_t>& ids, size_t from, size_t to) {
+    if (from >= to) return;
+    if constexpr (!Enc::needs_word) {
+        // Ids come from the index alone
+        for (size_t i = from; i < to; ++i) Enc::word(out, std::string_view(), ids, i);
+        return;
+    }
+    CorpusWalk walk(words, from);
+    Enc::word(out, walk.next(), ids, from);
+    for (size_t i = from + 1; i < to; ++i) {
+        Enc::sep(out);
+        Enc::word(out, walk.next(), ids, i);
+    }
+}
+
+// Encode the reply to a "p,k" request
+template <typename Enc, typename Frame, typename Out>
+void encode_chunk(Out& out, const Corpus& words, const std::vector<uint32_t>& ids, int p, int k) {
+    size_t size = words.size();
+    size_t from = p < 0 ? size : std::min(size, static_cast<size_t>(p));
+    size_t to = k > 0 ? std::min(size, from + k) : from;
+    bool eof = from >= size || (k > 0 && from + k > size);
+    uint32_t count = static_cast<uint32_t>(to - from);
+    Frame::begin(out, count, eof);
+    encode_words<Enc>(out, words, ids, from, to);
+    Frame::end(out, count, eof);
+}
+
+using ChunkEncoder = void (*)(OutBuf&, const Corpus&, const std::vector<uint32_t>&, int, int);
+
+// Server-held read position created by OPEN and advanced by NEXT
+struct Cursor {
+    bool open = false;
+    int64_t pos = 0;  // keeps growing by k on NEXT past the end
+    int k = 0;
+    uint64_t version = 0;
+    int64_t ahead_pos = -1;  // position the read-ahead chunk was built for
+    OutBuf ahead;
+};
+
+// A cursor position as an encoder argument; every position past the end reads as EOF
+int chunk_pos(int64_t pos, size_t size) {
+    return static_cast<int>(std::min(pos, static_cast<int64_t>(size)));
+}
+
+// "OPEN p,k[,version]" -> "OK version,size", or "ERR version <current>" on mismatch
+std::string open_cursor(Cursor& cur, const std::string& args, const Corpus& words, uint64_t version) {
+    size_t comma_pos = args.find(',');
+    if (comma_pos == std::string::npos) throw std::invalid_argument("Invalid OPEN format");
+    long long p = std::stoll(args.substr(0, comma_pos));
+    int k = std::stoi(args.substr(comma_pos + 1));
+    size_t comma2 = args.find(',', comma_pos + 1);
+    if (comma2 != std::string::npos && std::stoull(args.substr(comma2 + 1)) != version) {
+        cur.open = false;
+        return "ERR version " + std::to_string(version) + "\n";
+    }
+    if (k <= 0 || p < 0) throw std::invalid_argument("Invalid OPEN range");
+    cur.open = true;
+    cur.pos = p;
+    cur.k = k;
+    cur.version = version;
+    cur.ahead_pos = -1;
+    return "OK " + std::to_string(version) + "," + std::to_string(words.size()) + "\n";
+}
+
+// Chunks "NEXT [n]" reads from the cursor: up to n, stopping after the one that
+// carries EOF; 0 after an error reply (no cursor, stale version, or n < 1)
+int next_count(const Cursor& cur, const std::string& args, size_t size, uint64_t version, OutBuf& out) {
+    if (!cur.open) {
+        out.append("ERR no cursor\n");
+        return 0;
+    }
+    if (cur.version != version) {
+        out.append("ERR version " + std::to_string(version) + "\n");
+        return 0;
+    }
+    int n = args.empty() ? 1 : std::stoi(args);
+    if (n <= 0) {
+        out.append("ERR next\n");
+        return 0;
+    }
+    int64_t left = static_cast<int64_t>(size) - cur.pos;
+    return left < 0 ? 1 : static_cast<int>(std::min<int64_t>(n, left / cur.k + 1));
+}
+
+// "NEXT [n]" -> up to n chunks, stopping after the one that carries EOF
+void next_chunks(Cursor& cur, const std::string& args, const Corpus& words, const std::vector<uint32_t>& ids,
+                 uint64_t version, ChunkEncoder encode, OutBuf& out) {
+    int n = next_count(cur, args, words.size(), version, out);
+    for (int i = 0; i < n; ++i) {
+        if (cur.ahead_pos == cur.pos) out.splice(cur.ahead);
+        else encode(out, words, ids, chunk_pos(cur.pos, words.size()), cur.k);
+        cur.ahead_pos = -1;
+        cur.pos += cur.k;
     }
-    words.push_back(content.substr(start)); // Add the last word
-    return words;
 }
 
-// Function to handle a client connection
-void handle_client(int client_socket, const std::vector<std::string>& words) {
-    char buffer[1024] = {0};
+// Prepare the chunk the next NEXT will ask for, once the current reply is on the wire.
+// NEXT splices the prepared blocks onto the send queue without copying.
+void read_ahead(Cursor& cur, const Corpus& words, const std::vector<uint32_t>& ids, ChunkEncoder encode) {
+    if (!cur.open || cur.pos >= static_cast<int64_t>(words.size()) || cur.ahead_pos == cur.pos) return;
+    cur.ahead.clear();
+    encode(cur.ahead, words, ids, chunk_pos(cur.pos, words.size()), cur.k);
+    cur.ahead_pos = cur.pos;
+}
+
+// Peer registry for peer-assisted downloads: which client listeners hold which word ranges
+struct Tracker {
+    struct Entry {
+        std::string addr;  // "ip:port" of the peer's listener
+        int start, end;
+        int owner;         // socket of the tracker connection that registered it
+        uint64_t handed_out = 0;
+    };
+    std::mutex mu;
+    std::vector<Entry> peers;
+};
+
+// "HAVE port,start,end": the asking client now serves [start, end) on its listener (no reply)
+void tracker_have(Tracker& tr, const std::string& args, int owner, const std::string& ip) {
+    std::vector<int> v;
+    size_t start = 0, comma;
+    while ((comma = args.find(',', start)) != std::string::npos) {
+        v.push_back(std::stoi(args.substr(start, comma - start)));
+        start = comma + 1;
+    }
+    v.push_back(std::stoi(args.substr(start)));
+    if (v.size() != 3) throw std::invalid_argument("Invalid HAVE format");
+    std::string addr = ip + ":" + std::to_string(v[0]);
+    std::lock_guard<std::mutex> lock(tr.mu);
+    for (auto& e : tr.peers) {
+        if (e.addr == addr) { e.start = v[1]; e.end = v[2]; e.owner = owner; return; }
+    }
+    tr.peers.push_back({addr, v[1], v[2], owner});
+}
+
+// "PEER p,k" -> "PEER ip:port" of the least-used peer holding [p, p+k), or "NONE"
+std::string tracker_peer(Tracker& tr, const std::string& args, int owner) {
+    size_t comma_pos = args.find(',');
+    if (comma_pos == std::string::npos) throw std::invalid_argument("Invalid PEER format");
+    int p = std::stoi(args.substr(0, comma_pos));
+    int k = std::stoi(args.substr(comma_pos + 1));
+    std::lock_guard<std::mutex> lock(tr.mu);
+    Tracker::Entry* best = nullptr;
+    for (auto& e : tr.peers) {
+        if (e.owner != owner && e.start <= p && p + k <= e.end && (!best || e.handed_out < best->handed_out)) best = &e;
+    }
+    if (!best) return "NONE\n";
+    best->handed_out++;
+    return "PEER " + best->addr + "\n";
+}
+
+void tracker_drop(Tracker& tr, int owner) {
+    std::lock_guard<std::mutex> lock(tr.mu);
+    tr.peers.erase(std::remove_if(tr.peers.begin(), tr.peers.end(),
+                                  [owner](const Tracker::Entry& e) { return e.owner == owner; }),
+                   tr.peers.end());
+}
+
+// Multicast push of the whole corpus. Subscribers learn the group and packet count over
+// TCP; the sender thread pushes every packet once per round, starting mcast_wait_ms after
+// the first SUBSCRIBE so that clients arriving together share one round. Lost packets
+// are repaired over each client's TCP connection with NACK.
+struct Multicast {
+    bool enabled = false;
+    std::string group, iface;
+    int port = 0;
+    int wait_ms = 100;
+    int pace_us = 20;                   // gap between packets so receivers keep up
+    std::vector<std::string> packets;   // the comma-joined corpus in slices of 1400 bytes
+    std::mutex mu;
+    std::condition_variable cv;
+    bool round_pending = false;
+};
+
+// Cut the comma-joined corpus into datagram-sized payloads. Cuts fall anywhere, even
+// inside a word, so a receiver joins the payloads in sequence order before splitting:
+// a word longer than a datagram spans several, and empty words stay ",,".
+std::vector<std::string> make_packets(const Corpus& words, size_t max_payload) {
+    std::vector<std::string> packets;
+    std::string cur;
+    auto put = [&](std::string_view s) {
+        while (!s.empty()) {
+            size_t n = std::min(s.size(), max_payload - cur.size());
+            cur.append(s.data(), n);
+            s.remove_prefix(n);
+            if (cur.size() == max_payload) {
+                packets.push_back(std::move(cur));
+                cur.clear();
+            }
+        }
+    };
+    if (words.size() > 0) {
+        CorpusWalk walk(words, 0);
+        for (size_t i = 0; i < words.size(); ++i) {
+            if (i > 0) put(",");
+            put(walk.next());
+        }
+    }
+    if (!cur.empty()) packets.push_back(std::move(cur));
+    return packets;
+}
+
+// Datagram: 4-byte sequence number and 4-byte packet count (network order), then payload
+void multicast_sender(Multicast& mc) {
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    unsigned char ttl = 1, loop = 1;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    if (!mc.iface.empty()) {
+        struct in_addr iface;
+        inet_pton(AF_INET, mc.iface.c_str(), &iface);
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &iface, sizeof(iface));
+    }
+    struct sockaddr_in dest = {};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(mc.port);
+    inet_pton(AF_INET, mc.group.c_str(), &dest.sin_addr);
+
+    uint32_t total = htonl(static_cast<uint32_t>(mc.packets.size()));
+    std::string dgram;
     while (true) {
-        ssize_t bytes_read = read(client_socket, buffer, 1023);
-        if (bytes_read <= 0) {
-            // Client closed connection or error occurred
-            break;
+        {
+            std::unique_lock<std::mutex> lock(mc.mu);
+            mc.cv.wait(lock, [&mc] { return mc.round_pending; });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(mc.wait_ms));
+        {
+            std::lock_guard<std::mutex> lock(mc.mu);
+            mc.round_pending = false;
+        }
+        for (size_t i = 0; i < mc.packets.size(); ++i) {
+            uint32_t seq = htonl(static_cast<uint32_t>(i));
+            dgram.assign(reinterpret_cast<const char*>(&seq), 4);
+            dgram.append(reinterpret_cast<const char*>(&total), 4);
+            dgram += mc.packets[i];
+            sendto(fd, dgram.data(), dgram.size(), 0, (struct sockaddr *)&dest, sizeof(dest));
+            if (mc.pace_us > 0) std::this_thread::sleep_for(std::chrono::microseconds(mc.pace_us));
         }
+    }
+}
 
-        std::string req(buffer, bytes_read);
-        std::string response;
-        try {
-            size_t comma_pos = req.find(',');
-            if (comma_pos == std::string::npos) throw std::invalid_argument("Invalid request format");
-
-            int p = std::stoi(req.substr(0, comma_pos));
-            int k = std::stoi(req.substr(comma_pos + 1));
-
-            if (p >= static_cast<int>(words.size()) || p < 0) {
-                response = "EOF\n";
-            } else {
-                std::string partial_response;
-                bool eof_reached = false;
-                for (int i = 0; i < k; ++i) {
-                    int current_pos = p + i;
-                    if (current_pos < static_cast<int>(words.size())) {
-                        if (i > 0) partial_response += ",";
-                        partial_response += words[current_pos];
-                    } else {
-                        partial_response += ",EOF";
-                        eof_reached = true;
-                        break;
-                    }
+// "SUBSCRIBE" -> "MCAST group,port,packets,version" and schedules a push round
+std::string multicast_subscribe(Multicast& mc, uint64_t version) {
+    if (!mc.enabled) return "ERR no multicast\n";
+    {
+        std::lock_guard<std::mutex> lock(mc.mu);
+        mc.round_pending = true;
+    }
+    mc.cv.notify_one();
+    return "MCAST " + mc.group + "," + std::to_string(mc.port) + "," + std::to_string(mc.packets.size()) + "," +
+           std::to_string(version) + "\n";
+}
+
+// "NACK s1,s2,..." -> one "seq:payload" line per requested packet
+std::string multicast_repair(const Multicast& mc, const std::string& args) {
+    std::string response;
+    size_t start = 0;
+    while (start < args.size()) {
+        size_t comma = args.find(',', start);
+        if (comma == std::string::npos) comma = args.size();
+        size_t seq = std::stoul(args.substr(start, comma - start));
+        if (seq >= mc.packets.size()) throw std::invalid_argument("Invalid NACK sequence");
+        response += std::to_string(seq) + ":" + mc.packets[seq] + "\n";
+        start = comma + 1;
+    }
+    return response;
+}
+
+// Binary request trace: an 8-byte header ("WTRC", u32 record size) followed by
+// fixed-size little-endian records. The record size doubles as the format version:
+// a reader built for another layout refuses the file. Records are batched in memory and written out
+// when the batch fills, and once more on SIGINT/SIGTERM.
+#pragma pack(push, 1)
+struct TraceRecord {
+    uint64_t ts_us;  // microseconds since the server started
+    uint32_t conn;
+    int64_t p;
+    int64_t k;
+};
+#pragma pack(pop)
+
+struct TraceLog {
+    int fd = -1;
+    std::mutex mu;
+    std::vector<TraceRecord> batch;
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+    bool open_file(const std::string& path) {
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        uint32_t header[2] = {0x43525457, sizeof(TraceRecord)};  // "WTRC"
+        return write(fd, header, sizeof(header)) == sizeof(header);
+    }
+    void flush_locked() {
+        if (fd >= 0 && !batch.empty()) {
+            ssize_t ignored = write(fd, batch.data(), batch.size() * sizeof(TraceRecord));
+            (void)ignored;
+        }
+        batch.clear();
+    }
+    void record(uint32_t conn, int64_t p, int64_t k) {
+        if (fd < 0) return;
+        uint64_t ts = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+        std::lock_guard<std::mutex> lock(mu);
+        batch.push_back({ts, conn, p, k});
+        if (batch.size() >= 4096) flush_locked();
+    }
+    void flush() {
+        std::lock_guard<std::mutex> lock(mu);
+        flush_locked();
+    }
+};
+
+// Transport tuning applied per connection: pacing and socket buffer sizes
+struct Tuning {
+    uint64_t pacing_rate = 0;  // bytes/s for a weight-1 connection, 0 = no pacing
+    bool autotune = false;     // size SO_SNDBUF/SO_RCVBUF from the measured BDP
+    int autotune_every = 64;   // requests between TCP_INFO samples
+};
+
+// "WEIGHT w": pace this connection at w times the base rate. There is never a reply,
+// so a malformed weight, or one sent while "pacing_rate" is off, is ignored.
+void apply_weight(int sock, const Tuning& tune, double weight) {
+    if (tune.pacing_rate == 0 || !(weight > 0)) return;
+    uint64_t rate = static_cast<uint64_t>(tune.pacing_rate * weight);
+    setsockopt(sock, SOL_SOCKET, SO_MAX_PACING_RATE, &rate, sizeof(rate));
+}
+
+// Size the socket buffers to twice the bandwidth-delay product seen by TCP_INFO,
+// using the pacing rate as the bandwidth when it is lower than the delivery rate.
+// Setting SO_SNDBUF turns off the kernel's own autotuning for this socket, so this
+// only kicks in when asked for.
+void autotune_buffers(int sock, uint64_t pacing_rate) {
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) < 0 || info.tcpi_rtt == 0) return;
+    uint64_t bw = info.tcpi_delivery_rate;
+    if (pacing_rate && (bw == 0 || pacing_rate < bw)) bw = pacing_rate;
+    if (bw == 0) return;
+    uint64_t bdp = bw * info.tcpi_rtt / 1000000;
+    int size = static_cast<int>(std::min<uint64_t>(std::max<uint64_t>(2 * bdp, 16 * 1024), 4 * 1024 * 1024));
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+}
+
+// Live connections and counters reported by STATS
+struct Telemetry {
+    std::mutex mu;
+    std::map<uint32_t, int> conns;  // conn id -> socket, closed only after removal
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> migrations{0};
+    std::atomic<uint64_t> tls_kernel{0};  // TLS connections whose records the kernel encrypts
+    std::atomic<uint64_t> tls_user{0};    // TLS connections left on SSL_write/SSL_read
+    std::string congestion;
+};
+
+// "STATS" -> one JSON line with server counters and a TCP_INFO sample per connection
+std::string stats_report(Telemetry& tel) {
+    std::lock_guard<std::mutex> lock(tel.mu);
+    std::string response = "STATS {\"connections\":" + std::to_string(tel.conns.size()) +
+                           ",\"requests\":" + std::to_string(tel.requests.load()) +
+                           ",\"bytes_sent\":" + std::to_string(tel.bytes_sent.load()) +
+                           ",\"migrations\":" + std::to_string(tel.migrations.load()) +
+                           ",\"pool_mallocs\":" + std::to_string(block_mallocs.load()) +
+                           ",\"ktls\":" + std::to_string(tel.tls_kernel.load()) +
+                           ",\"tls_user\":" + std::to_string(tel.tls_user.load()) +
+                           ",\"congestion\":\"" + tel.congestion + "\",\"conns\":[";
+    bool first = true;
+    for (const auto& c : tel.conns) {
+        response += (first ? "" : ",") + std::string("{\"id\":") + std::to_string(c.first) + ",\"tcp\":" + tcp_info_json(c.second) + "}";
+        first = false;
+    }
+    return response + "]}\n";
+}
+
+// Work-stealing scheduler for requests too large for one thread. Every participating
+// thread (event workers and helper threads) owns a deque. A worker splits a big request
+// into chunk tasks, pushes them onto its own deque and works through them from the back,
+// while idle threads steal from the front. The worker keeps helping until its group is
+// done, so one huge request is spread over every core instead of pinning one.
+struct TaskGroup {
+    std::atomic<int> remaining{0};
+};
+
+struct Task {
+    std::function<void()> fn;
+    TaskGroup* group;
+};
+
+struct TaskPool {
+    struct Deque {
+        std::mutex mu;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Deque>> deques;
+    std::atomic<int> registered{0};
+    std::atomic<int> queued{0};
+    std::mutex idle_mu;
+    std::condition_variable idle_cv;
+    size_t chunk_words = 65536;  // words per task; requests at most this size stay inline
+
+    void init(int slots) {
+        for (int i = 0; i < slots; ++i) deques.push_back(std::make_unique<Deque>());
+    }
+
+    // Index of the calling thread's deque (one pool per process)
+    inline static thread_local int slot = -1;
+
+    // Give the calling thread its deque; every thread that splits or runs tasks enters
+    // once at startup, and init made a deque for each of them
+    void enter() {
+        assert(slot < 0);
+        slot = registered++;
+        assert(slot < static_cast<int>(deques.size()));
+    }
+
+    Deque& mine() {
+        assert(slot >= 0 && slot < static_cast<int>(deques.size()));
+        return *deques[slot];
+    }
+
+    void push(Task t) {
+        Deque& d = mine();
+        {
+            std::lock_guard<std::mutex> lock(d.mu);
+            d.tasks.push_back(std::move(t));
+        }
+        queued++;
+        idle_cv.notify_all();
+    }
+
+    bool pop_own(Task& t) {
+        Deque& d = mine();
+        std::lock_guard<std::mutex> lock(d.mu);
+        if (d.tasks.empty()) return false;
+        t = std::move(d.tasks.back());
+        d.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(Task& t) {
+        Deque* self = &mine();
+        for (auto& d : deques) {
+            if (d.get() == self) continue;
+            std::lock_guard<std::mutex> lock(d->mu);
+            if (d->tasks.empty()) continue;
+            t = std::move(d->tasks.front());
+            d->tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void run(Task& t) {
+        queued--;
+        t.fn();
+        if (--t.group->remaining == 0) {
+            // Taking the lock orders this against a waiter between its check and its sleep
+            { std::lock_guard<std::mutex> lock(idle_mu); }
+            idle_cv.notify_all();
+        }
+    }
+
+    // Run tasks until the group finishes, stealing when our own deque runs dry. With
+    // nothing left to take, sleep until the last task of the group ends or more are queued.
+    void wait(TaskGroup& group) {
+        Task t;
+        while (group.remaining > 0) {
+            if (pop_own(t) || steal(t)) {
+                run(t);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(idle_mu);
+            idle_cv.wait(lock, [&] { return group.remaining == 0 || queued > 0; });
+        }
+    }
+
+    void helper_loop() {
+        enter();
+        Task t;
+        while (true) {
+            if (pop_own(t) || steal(t)) { run(t); continue; }
+            std::unique_lock<std::mutex> lock(idle_mu);
+            idle_cv.wait_for(lock, std::chrono::milliseconds(50), [this] { return queued > 0; });
+        }
+    }
+};
+
+// Split [from, to) into chunk tasks, run them on the pool and wait for all of them
+void parallel_chunks(TaskPool& pool, size_t from, size_t to, const std::function<void(size_t, size_t, size_t)>& fn) {
+    size_t n = (to - from + pool.chunk_words - 1) / pool.chunk_words;
+    TaskGroup group;
+    group.remaining = static_cast<int>(n);
+    for (size_t i = 0; i < n; ++i) {
+        size_t a = from + i * pool.chunk_words, b = std::min(to, a + pool.chunk_words);
+        pool.push({[&fn, i, a, b] { fn(i, a, b); }, &group});
+    }
+    pool.wait(group);
+}
+
+// encode_chunk for a large k: each task encodes its slice of the range, then the
+// slices are stitched together in order
+template <typename Enc, typename Frame>
+std::string encode_chunk_parallel(TaskPool& pool, const Corpus& words, const std::vector<uint32_t>& ids, int p, int k) {
+    std::string response;
+    if (p < 0 || p >= static_cast<int>(words.size())) {
+        encode_chunk<Enc, Frame>(response, words, ids, p, k);
+        return response;
+    }
+    size_t end = std::min(words.size(), static_cast<size_t>(p) + k);
+    std::vector<std::string> parts((end - p + pool.chunk_words - 1) / pool.chunk_words);
+    parallel_chunks(pool, p, end, [&](size_t idx, size_t a, size_t b) {
+        encode_words<Enc>(parts[idx], words, ids, a, b);
+    });
+    size_t total = 0;
+    for (const auto& part : parts) total += part.size() + 1;
+    response.reserve(total + 10);
+    bool eof = static_cast<size_t>(p) + k > words.size();
+    uint32_t count = static_cast<uint32_t>(end - p);
+    Frame::begin(response, count, eof);
+    for (size_t i = 0; i < parts.size(); ++i) {
+        if (i > 0) Enc::sep(response);
+        response += parts[i];
+    }
+    Frame::end(response, count, eof);
+    return response;
+}
+
+// The encoders a connection can select with "MODE <name>"
+struct EncoderMode {
+    const char* name;
+    ChunkEncoder encode;
+    std::string (*encode_parallel)(TaskPool&, const Corpus&, const std::vector<uint32_t>&, int, int);
+    bool needs_dict;
+    size_t max_word;  // longest word the encoding can carry
+};
+
+const EncoderMode kModes[] = {
+    {"text", encode_chunk<TextWords, LineFrame, OutBuf>, encode_chunk_parallel<TextWords, LineFrame>, false, SIZE_MAX},
+    {"binary", encode_chunk<BinaryWords, CountedFrame, OutBuf>, encode_chunk_parallel<BinaryWords, CountedFrame>, false, 0xFFFF},
+    {"ids", encode_chunk<IdWords, CountedFrame, OutBuf>, encode_chunk_parallel<IdWords, CountedFrame>, true, SIZE_MAX},
+};
+
+// Distinct words in order of first appearance, and each position's index into them
+void make_dictionary(const Corpus& words, std::vector<std::string>& dict, std::vector<uint32_t>& ids) {
+    std::unordered_map<std::string_view, uint32_t> index;  // views into the corpus mappings
+    ids.reserve(words.size());
+    for (size_t i = 0; i < words.size(); ++i) {
+        std::string_view w = words[i];
+        auto it = index.emplace(w, static_cast<uint32_t>(dict.size())).first;
+        if (it->second == dict.size()) dict.emplace_back(w);
+        ids.push_back(it->second);
+    }
+}
+
+// Case folding applied to words as COUNT counts them ("fold_case")
+enum class CaseFold { None, Ascii, Unicode };
+
+// Fold w into out (see fold.h)
+void fold_word(std::string_view w, CaseFold mode, std::string& out) {
+    out.clear();
+    fold_word(w.data(), w.size(), mode == CaseFold::Unicode, out);
+}
+
+// "COUNT p,k" -> "word:count,..." for [p, p+k), sorted by word. Per-chunk counts
+// are computed in parallel and merged.
+std::string count_range(TaskPool& pool, const Corpus& words, CaseFold fold, const std::string& args) {
+    size_t comma_pos = args.find(',');
+    if (comma_pos == std::string::npos) throw std::invalid_argument("Invalid COUNT format");
+    long long p = std::stoll(args.substr(0, comma_pos));
+    long long k = std::stoll(args.substr(comma_pos + 1));
+    if (p < 0 || k < 0) throw std::invalid_argument("Invalid COUNT range");
+    size_t from = std::min(words.size(), static_cast<size_t>(p));
+    size_t to = std::min(words.size(), static_cast<size_t>(p + k));
+    size_t chunks = (to - from + pool.chunk_words - 1) / pool.chunk_words;
+    std::vector<std::unordered_map<std::string_view, int>> partial(fold == CaseFold::None ? chunks : 0);
+    std::vector<std::unordered_map<std::string, int>> partial_folded(fold == CaseFold::None ? 0 : chunks);
+    if (to > from) {
+        parallel_chunks(pool, from, to, [&](size_t idx, size_t a, size_t b) {
+            std::string folded;
+            CorpusWalk walk(words, a);
+            for (size_t i = a; i < b; ++i) {
+                std::string_view w = walk.next();
+                if (w.empty()) continue;
+                if (fold == CaseFold::None) {
+                    partial[idx][w]++;
+                } else {
+                    fold_word(w, fold, folded);
+                    partial_folded[idx][folded]++;
                 }
-                response = partial_response + "\n";
+            }
+        });
+    }
+    std::map<std::string, int> merged;
+    for (const auto& m : partial) {
+        for (const auto& pair : m) merged[std::string(pair.first)] += pair.second;
+    }
+    for (const auto& m : partial_folded) {
+        for (const auto& pair : m) merged[pair.first] += pair.second;
+    }
+    std::string response;
+    for (const auto& pair : merged) {
+        if (!response.empty()) response += ",";
+        response += pair.first + ":" + std::to_string(pair.second);
+    }
+    return response + "\n";
+}
+
+// Request scheduling across connections ("scheduler": "fcfs" or "rr"), the native
+// counterpart of the part 3 FCFS and part 4 round-robin Python servers. "p,k" requests
+// are queued instead of answered inline, and one service thread takes them in policy
+// order, spending "service_us" plus up to "service_jitter_us" on each the way the Python
+// servers sleep per request. Replies go back to the worker that owns the connection
+// through its eventfd. "NEXT" and "COUNT" are queued the same way, and an HTTP request
+// waits for its turn before its worker answers it. The cheap control commands are
+// answered inline, but a reply is only sent once every earlier reply on its connection
+// has been, so replies always arrive in request order. Connections are not migrated
+// while a scheduler runs, so a reply always finds its connection.
+//
+// "edf" serves by strict priority class (0 first), and earliest deadline first within a
+// class. A connection picks its class and default deadline with "PRIORITY <class>
+// [deadline_ms]"; "p,k,deadline_ms" sets the deadline of one request. Every "aging_ms"
+// a waiting request spends in its class promotes it one class, so bulk work still runs.
+//
+// "srpt" serves the connection with the least work left, estimated as the words from its
+// oldest queued request to the end of the corpus, which minimizes mean download completion
+// time. A connection whose oldest request has waited "max_wait_ms" is served first.
+enum class SchedPolicy { None, Fcfs, RoundRobin, Edf, Srpt };
+
+constexpr int kSchedClasses = 4;
+
+enum class SchedJob {
+    Chunks,  // "p,k", or "NEXT": `chunks` chunks of k words from p
+    Count,   // "COUNT": count_range over `args`
+    Admit,   // HTTP: no reply; the worker answers the request once it is admitted
+};
+
+struct SchedRequest {
+    int worker;
+    int fd;
+    uint32_t conn_id;
+    int p, k;
+    ChunkEncoder encode;
+    SchedJob job = SchedJob::Chunks;
+    int chunks = 1;
+    std::string args;
+    uint64_t reply = 0;  // position of the reply among its connection's replies
+    // edf only
+    int cls = 0;
+    int64_t deadline_us = 0;
+    int64_t since_us = 0;  // edf: entered its current class; srpt: queued
+    uint64_t seq = 0;
+    int64_t remaining = 0;  // srpt: corpus words from p on
+};
+
+// One edf priority class: its requests by (deadline, seq), and by time in the class for aging
+struct SchedClass {
+    std::set<std::pair<int64_t, uint64_t>> by_deadline;
+    std::deque<std::pair<int64_t, uint64_t>> by_age;  // (since_us, seq); stale entries skipped
+};
+
+struct SchedReply {
+    SchedReply(int fd, uint32_t conn_id, uint64_t reply) : fd(fd), conn_id(conn_id), reply(reply) {}
+    int fd;
+    uint32_t conn_id;
+    uint64_t reply;
+    OutBuf out;
+};
+
+struct SchedOutbox {
+    std::mutex mu;
+    std::deque<SchedReply> replies;
+    int wake_fd = -1;
+};
+
+struct Scheduler {
+    SchedPolicy policy = SchedPolicy::None;
+    int service_us = 0;
+    int jitter_us = 0;
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<SchedRequest> fifo;                                  // fcfs: arrival order
+    std::unordered_map<uint32_t, std::deque<SchedRequest>> queues;  // rr, srpt: per connection
+    std::deque<uint32_t> turns;                                     // rr: connections with work, in turn order
+    std::unordered_map<uint64_t, SchedRequest> pending;             // edf: queued requests by seq
+    SchedClass classes[kSchedClasses];                              // edf
+    uint64_t next_seq = 0;
+    int default_class = 1;
+    int deadline_ms = 1000;  // edf: when neither the request nor its connection sets one
+    int aging_ms = 500;
+    std::set<std::pair<int64_t, uint32_t>> by_remaining;            // srpt: (remaining, conn) of each queue head
+    std::set<std::pair<int64_t, uint32_t>> by_wait;                 // srpt: (since_us, conn) of each queue head
+    int max_wait_ms = 1000;
+    std::vector<std::unique_ptr<SchedOutbox>> outboxes;             // one per worker
+};
+
+int64_t sched_now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool sched_idle(const Scheduler& sch) {
+    return sch.fifo.empty() && sch.turns.empty() && sch.pending.empty() && sch.by_remaining.empty();
+}
+
+// Index (or unindex) the head request of a srpt connection queue
+void srpt_link(Scheduler& sch, uint32_t id, const SchedRequest& head) {
+    sch.by_remaining.emplace(head.remaining, id);
+    sch.by_wait.emplace(head.since_us, id);
+}
+
+void srpt_unlink(Scheduler& sch, uint32_t id, const SchedRequest& head) {
+    sch.by_remaining.erase({head.remaining, id});
+    sch.by_wait.erase({head.since_us, id});
+}
+
+// Queue an edf request in class r.cls; the caller holds the lock
+void sched_enqueue_class(Scheduler& sch, SchedRequest& r) {
+    SchedClass& q = sch.classes[r.cls];
+    q.by_deadline.emplace(r.deadline_us, r.seq);
+    if (r.cls > 0) q.by_age.emplace_back(r.since_us, r.seq);  // class 0 has nowhere to go
+}
+
+// Promote every request that has waited aging_ms in its class by one class
+void sched_age(Scheduler& sch, int64_t now) {
+    int64_t aging_us = static_cast<int64_t>(sch.aging_ms) * 1000;
+    if (aging_us <= 0) return;
+    for (int c = 1; c < kSchedClasses; ++c) {
+        auto& ages = sch.classes[c].by_age;
+        while (!ages.empty()) {
+            auto it = sch.pending.find(ages.front().second);
+            if (it == sch.pending.end() || it->second.cls != c) {
+                ages.pop_front();  // served or dropped
+                continue;
+            }
+            if (ages.front().first + aging_us > now) break;
+            ages.pop_front();
+            SchedRequest& r = it->second;
+            sch.classes[c].by_deadline.erase({r.deadline_us, r.seq});
+            r.cls = c - 1;
+            r.since_us = now;
+            sched_enqueue_class(sch, r);
+        }
+    }
+}
+
+void sched_submit(Scheduler& sch, const SchedRequest& r) {
+    {
+        std::lock_guard<std::mutex> lock(sch.mu);
+        if (sch.policy == SchedPolicy::Fcfs) {
+            sch.fifo.push_back(r);
+        } else if (sch.policy == SchedPolicy::Edf) {
+            SchedRequest& q = sch.pending.emplace(sch.next_seq, r).first->second;
+            q.seq = sch.next_seq++;
+            q.since_us = sched_now_us();
+            q.deadline_us += q.since_us;  // submitted relative
+            sched_enqueue_class(sch, q);
+        } else if (sch.policy == SchedPolicy::Srpt) {
+            auto& q = sch.queues[r.conn_id];
+            q.push_back(r);
+            q.back().since_us = sched_now_us();
+            if (q.size() == 1) srpt_link(sch, r.conn_id, q.front());
+        } else {
+            auto& q = sch.queues[r.conn_id];
+            if (q.empty()) sch.turns.push_back(r.conn_id);
+            q.push_back(r);
+        }
+    }
+    sch.cv.notify_one();
+}
+
+// Next request in policy order; the caller holds the lock and there is work
+SchedRequest sched_next(Scheduler& sch) {
+    if (sch.policy == SchedPolicy::Fcfs) {
+        SchedRequest r = sch.fifo.front();
+        sch.fifo.pop_front();
+        return r;
+    }
+    if (sch.policy == SchedPolicy::Edf) {
+        sched_age(sch, sched_now_us());
+        SchedClass* q = sch.classes;
+        while (q->by_deadline.empty()) ++q;
+        auto it = sch.pending.find(q->by_deadline.begin()->second);
+        q->by_deadline.erase(q->by_deadline.begin());
+        SchedRequest r = it->second;
+        sch.pending.erase(it);
+        return r;
+    }
+    if (sch.policy == SchedPolicy::Srpt) {
+        // Least remaining work, unless some connection has waited past the limit
+        uint32_t id = sch.by_remaining.begin()->second;
+        if (sch.max_wait_ms > 0 && sch.by_wait.begin()->first + static_cast<int64_t>(sch.max_wait_ms) * 1000 <= sched_now_us()) {
+            id = sch.by_wait.begin()->second;
+        }
+        auto it = sch.queues.find(id);
+        SchedRequest r = it->second.front();
+        srpt_unlink(sch, id, r);
+        it->second.pop_front();
+        if (it->second.empty()) sch.queues.erase(it);
+        else srpt_link(sch, id, it->second.front());
+        return r;
+    }
+    // Round robin: one request per turn, then the connection goes to the back
+    uint32_t id = sch.turns.front();
+    sch.turns.pop_front();
+    auto it = sch.queues.find(id);
+    SchedRequest r = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty()) sch.queues.erase(it);
+    else sch.turns.push_back(id);
+    return r;
+}
+
+// Forget the queued requests of a closed connection
+void sched_drop(Scheduler& sch, uint32_t conn_id) {
+    if (sch.policy == SchedPolicy::None) return;
+    std::lock_guard<std::mutex> lock(sch.mu);
+    sch.fifo.erase(std::remove_if(sch.fifo.begin(), sch.fifo.end(), [&](const SchedRequest& r) { return r.conn_id == conn_id; }),
+                   sch.fifo.end());
+    auto queue = sch.queues.find(conn_id);
+    if (queue != sch.queues.end()) {
+        if (sch.policy == SchedPolicy::Srpt) srpt_unlink(sch, conn_id, queue->second.front());
+        else sch.turns.erase(std::find(sch.turns.begin(), sch.turns.end(), conn_id));
+        sch.queues.erase(queue);
+    }
+    for (auto it = sch.pending.begin(); it != sch.pending.end();) {
+        if (it->second.conn_id != conn_id) {
+            ++it;
+            continue;
+        }
+        sch.classes[it->second.cls].by_deadline.erase({it->second.deadline_us, it->second.seq});
+        it = sch.pending.erase(it);
+    }
+}
+
+// State shared by every connection
+struct ServerContext {
+    Corpus words;
+    CaseFold fold = CaseFold::None;
+    uint64_t version = 0;
+    std::vector<Block> blocks;  // built on the first "BLOCKS"
+    int block_avg = 64;
+    std::once_flag blocks_once;
+    Tracker tracker;
+    Multicast mcast;
+    TraceLog trace;
+    Tuning tuning;
+    Telemetry telemetry;
+    TaskPool tasks;
+    std::vector<std::string> dict;  // built on the first "MODE ids" or "DICT"
+    std::vector<uint32_t> ids;
+    std::once_flag dict_once;
+#ifdef WORD_TLS
+    SSL_CTX* tls = nullptr;
+#endif
+    Scheduler sched;
+    std::atomic<uint32_t> next_conn{0};
+};
+
+// The service thread of the request scheduler
+void scheduler_loop(Scheduler& sch, ServerContext& ctx) {
+    ctx.tasks.enter();  // COUNT splits its range
+    std::mt19937 rng(std::random_device{}());
+    while (true) {
+        SchedRequest r;
+        {
+            std::unique_lock<std::mutex> lock(sch.mu);
+            sch.cv.wait(lock, [&] { return !sched_idle(sch); });
+            r = sched_next(sch);
+        }
+        int delay = sch.service_us + (sch.jitter_us > 0 ? std::uniform_int_distribution<int>(0, sch.jitter_us)(rng) : 0);
+        if (delay > 0) std::this_thread::sleep_for(std::chrono::microseconds(delay));
+        OutBuf out;
+        try {
+            if (r.job == SchedJob::Count) out.append(count_range(ctx.tasks, ctx.words, ctx.fold, r.args));
+            else if (r.job == SchedJob::Chunks) {
+                for (int i = 0; i < r.chunks; ++i) r.encode(out, ctx.words, ctx.ids, r.p + i * r.k, r.k);
             }
         } catch (const std::exception& e) {
-            response = "EOF\n"; // Send EOF for any parsing errors
+            out.append("EOF\n", 4);  // as conn_process answers a bad request
         }
+        SchedOutbox& box = *sch.outboxes[r.worker];
+        {
+            std::lock_guard<std::mutex> lock(box.mu);
+            box.replies.emplace_back(r.fd, r.conn_id, r.reply);
+            box.replies.back().out.splice(out);
+        }
+        uint64_t one = 1;
+        ssize_t ignored = write(box.wake_fd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+// Per-connection state
+struct Session {
+    int sock;
+    std::string peer_ip;
+    uint32_t conn_id;
+    Cursor cursor;
+    int requests_since_tune = 0;
+    const EncoderMode* mode = &kModes[0];
+    int worker = 0;  // index of the owning worker
+    int sched_class = -1;   // edf class from "PRIORITY"; -1: the server default
+    int deadline_ms = 0;    // edf default deadline from "PRIORITY"; 0: the server default
+    uint64_t replies_issued = 0;     // replies numbered so far, scheduled or held
+    uint64_t replies_sent = 0;       // of those, queued on the connection
+    std::map<uint64_t, OutBuf> held; // numbered replies waiting for an earlier one
+};
+
+// "PRIORITY <class> [deadline_ms]" -> "OK <class>": class and default deadline of this
+// connection's later "p,k" requests under the edf scheduler
+std::string select_priority(Session& s, const std::string& args) {
+    size_t used = 0;
+    int cls = std::stoi(args, &used);
+    int deadline_ms = 0;
+    if (used < args.size()) deadline_ms = std::stoi(args.substr(used));
+    if (cls < 0 || cls >= kSchedClasses || deadline_ms < 0) return "ERR priority\n";
+    s.sched_class = cls;
+    s.deadline_ms = deadline_ms;
+    return "OK " + std::to_string(cls) + "\n";
+}
+
+// "MODE <name>" -> "OK <name>": later chunks use that encoder; "DICT" -> the ids mode
+// dictionary as one text line. Control replies stay text lines in every mode. A mode
+// whose length prefix cannot hold the corpus's longest word is refused up front, since
+// a wrapped length would desync the whole stream.
+std::string select_mode(Session& s, ServerContext& ctx, const std::string& name) {
+    for (const auto& m : kModes) {
+        if (name != m.name) continue;
+        if (ctx.words.longest > m.max_word) return "ERR word too long\n";
+        if (m.needs_dict) std::call_once(ctx.dict_once, make_dictionary, std::cref(ctx.words), std::ref(ctx.dict), std::ref(ctx.ids));
+        s.mode = &m;
+        s.cursor.ahead.clear();
+        s.cursor.ahead_pos = -1;
+        return "OK " + name + "\n";
+    }
+    return "ERR mode\n";
+}
+
+std::string dictionary_line(ServerContext& ctx) {
+    std::call_once(ctx.dict_once, make_dictionary, std::cref(ctx.words), std::ref(ctx.dict), std::ref(ctx.ids));
+    std::string response;
+    for (size_t i = 0; i < ctx.dict.size(); ++i) {
+        if (i > 0) response += ",";
+        response += ctx.dict[i];
+    }
+    return response + "\n";
+}
+
+// Queue r with the connection's next reply number and its edf class; deadline_ms < 0
+// takes the connection's or the server's default deadline
+void sched_queue(Session& s, ServerContext& ctx, SchedRequest r, int deadline_ms = -1) {
+    if (deadline_ms < 0) deadline_ms = s.deadline_ms > 0 ? s.deadline_ms : ctx.sched.deadline_ms;
+    r.cls = s.sched_class >= 0 ? s.sched_class : ctx.sched.default_class;
+    r.deadline_us = static_cast<int64_t>(deadline_ms) * 1000;
+    r.remaining = std::max<int64_t>(0, static_cast<int64_t>(ctx.words.size()) - r.p);
+    r.reply = s.replies_issued++;
+    sched_submit(ctx.sched, r);
+}
 
-        send(client_socket, response.c_str(), response.length(), 0);
+// Dispatch one request line, appending the reply (if any) to out
+void handle_request(const std::string& req, Session& s, ServerContext& ctx, OutBuf& out) {
+    if (req == "BLOCKS") {
+        std::call_once(ctx.blocks_once, [&ctx] { ctx.blocks = make_blocks(ctx.words, ctx.block_avg); });
+        return out.append(list_blocks(ctx.blocks));
     }
-    close(client_socket);
+    if (req.compare(0, 5, "OPEN ") == 0) return out.append(open_cursor(s.cursor, req.substr(5), ctx.words, ctx.version));
+    if (req.compare(0, 4, "NEXT") == 0) {
+        size_t arg = req.find_first_not_of(' ', 4);
+        std::string args = arg == std::string::npos ? "" : req.substr(arg);
+        int64_t before = s.cursor.pos;
+        if (ctx.sched.policy == SchedPolicy::None) {
+            next_chunks(s.cursor, args, ctx.words, ctx.ids, ctx.version, s.mode->encode, out);
+        } else if (int n = next_count(s.cursor, args, ctx.words.size(), ctx.version, out)) {
+            SchedRequest r{s.worker, s.sock, s.conn_id, chunk_pos(s.cursor.pos, ctx.words.size()), s.cursor.k, s.mode->encode};
+            r.chunks = n;  // next_count keeps p + i * k within the corpus
+            s.cursor.pos += static_cast<int64_t>(n) * s.cursor.k;
+            sched_queue(s, ctx, r);
+        }
+        // Trace cursor reads as the equivalent "p,k" requests
+        for (int64_t pos = before; pos < s.cursor.pos; pos += s.cursor.k) ctx.trace.record(s.conn_id, chunk_pos(pos, ctx.words.size()), s.cursor.k);
+        return;
+    }
+    if (req.compare(0, 5, "HAVE ") == 0) return tracker_have(ctx.tracker, req.substr(5), s.sock, s.peer_ip);
+    if (req.compare(0, 5, "PEER ") == 0) return out.append(tracker_peer(ctx.tracker, req.substr(5), s.sock));
+    if (req == "STATS") return out.append(stats_report(ctx.telemetry));
+    if (req.compare(0, 5, "MODE ") == 0) return out.append(select_mode(s, ctx, req.substr(5)));
+    if (req == "DICT") return out.append(dictionary_line(ctx));
+    if (req.compare(0, 9, "PRIORITY ") == 0) return out.append(select_priority(s, req.substr(9)));
+    if (req.compare(0, 6, "COUNT ") == 0) {
+        if (ctx.sched.policy == SchedPolicy::None) return out.append(count_range(ctx.tasks, ctx.words, ctx.fold, req.substr(6)));
+        SchedRequest r{s.worker, s.sock, s.conn_id, 0, 0, nullptr};
+        r.job = SchedJob::Count;
+        r.args = req.substr(6);
+        r.p = static_cast<int>(std::min<long long>(std::max(0LL, atoll(r.args.c_str())), INT32_MAX));
+        return sched_queue(s, ctx, r);
+    }
+    if (req.compare(0, 7, "WEIGHT ") == 0) return apply_weight(s.sock, ctx.tuning, strtod(req.c_str() + 7, nullptr));
+    if (req == "SUBSCRIBE") return out.append(multicast_subscribe(ctx.mcast, ctx.version));
+    if (req.compare(0, 5, "NACK ") == 0) return out.append(multicast_repair(ctx.mcast, req.substr(5)));
+
+    size_t comma_pos = req.find(',');
+    if (comma_pos == std::string::npos) throw std::invalid_argument("Invalid request format");
+
+    int p = std::stoi(req.substr(0, comma_pos));
+    size_t used = 0;
+    int k = std::stoi(req.substr(comma_pos + 1), &used);
+    ctx.trace.record(s.conn_id, p, k);
+    if (ctx.sched.policy != SchedPolicy::None) {
+        SchedRequest r{s.worker, s.sock, s.conn_id, p, k, s.mode->encode};
+        // Optional ",deadline_ms" after k
+        size_t deadline_pos = comma_pos + 1 + used;
+        int deadline_ms = -1;
+        if (deadline_pos < req.size() && req[deadline_pos] == ',') deadline_ms = std::max(0, std::stoi(req.substr(deadline_pos + 1)));
+        return sched_queue(s, ctx, r, deadline_ms);
+    }
+    if (k > static_cast<int>(ctx.tasks.chunk_words)) return out.append(s.mode->encode_parallel(ctx.tasks, ctx.words, ctx.ids, p, k));
+    s.mode->encode(out, ctx.words, ctx.ids, p, k);
+}
+
+// HTTP/1.1 front end ("http_port"): "GET /words?p=..&k=.." and "GET /words" with
+// "Range: words=p-q" (inclusive, like byte ranges) both return the words joined by
+// commas. Connections are kept alive and may pipeline. A reply of more than kHttpSlice
+// words is streamed with chunked encoding, one slice each time the send queue drains,
+// so it is never held in memory whole. The corpus version doubles as the ETag.
+const size_t kHttpSlice = 4096;
+const size_t kHttpMaxHeader = 16384;
+
+struct HttpStream {
+    size_t start = 0, next = 0, end = 0;  // words of the reply, and the next one to send
+    bool active = false;
+    bool chunked = true;  // HTTP/1.0 clients get a body delimited by closing instead
+};
+
+// A client connection. It is owned by exactly one worker at a time and carries
+// everything needed to serve it, so ownership can move to another worker.
+struct Conn {
+    int fd;
+    Session session;
+    InBuf inbuf;
+    OutBuf outbuf;
+    uint32_t events = 0;   // epoll interest currently registered
+    uint64_t load = 0;     // bytes sent in the current balance window
+    bool http = false;         // accepted on the HTTP listener
+    bool close_after = false;  // close once the queued output is sent
+    bool http10 = false;       // the request being answered is HTTP/1.0
+    HttpStream stream;
+    bool waiting = false;      // http under a scheduler: the next request waits for its turn
+    bool admitted = false;     // ... and its turn has come
+    struct {
+#ifdef WORD_TLS
+        SSL* ssl = nullptr;
+        bool ktls_tx = false;  // the kernel encrypts what we send
+        bool ktls_rx = false;  // the kernel decrypts what we read
+#endif
+        bool handshaking = false;
+    } tls;
+};
+
+// One event loop thread with its own SO_REUSEPORT listener and epoll set
+struct Worker {
+    int id = 0;
+    int epfd = -1;
+    int listen_fd = -1;
+    int http_fd = -1;                         // HTTP listener, when "http_port" is set
+    int wake_fd = -1;                         // eventfd: migrated connections are waiting
+    std::mutex inbox_mu;
+    std::vector<Conn*> inbox;                 // connections handed over by other workers
+    std::unordered_map<int, Conn*> conns;
+    std::atomic<uint64_t> load{0};            // bytes sent in the last balance window
+    uint64_t window_bytes = 0;
+};
+
+// Load balancing across workers: every balance_ms each worker publishes the bytes it
+// sent in the last window. A worker carrying more than balance_ratio times the mean
+// hands its busiest connection (fd, buffers, cursor and all) to the least-loaded worker,
+// which SO_REUSEPORT's static hashing never does by itself.
+struct Balancer {
+    int balance_ms = 500;
+    double balance_ratio = 1.5;
+    std::vector<std::unique_ptr<Worker>> workers;
+};
+
+Conn* conn_new(int fd, const std::string& ip, uint32_t conn_id) {
+    void* mem;
+    if (conn_cache.free.empty()) {
+        mem = ::operator new(sizeof(Conn));
+    } else {
+        mem = conn_cache.free.back();
+        conn_cache.free.pop_back();
+    }
+    return new (mem) Conn{fd, {fd, ip, conn_id, {}}};
+}
+
+void conn_delete(Conn* c) {
+    c->~Conn();
+    if (conn_cache.free.size() < conn_cache_limit) conn_cache.free.push_back(c);
+    else ::operator delete(c);
+}
+
+void conn_set_events(Worker& w, Conn* c, uint32_t events) {
+    if (c->events == events) return;
+    struct epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = c->fd;
+    epoll_ctl(w.epfd, c->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, c->fd, &ev);
+    c->events = events;
+}
+
+// Optional TLS ("tls_cert" and "tls_key", build with make TLS=1). OpenSSL runs the
+// handshake in user space with SSL_OP_ENABLE_KTLS, which installs the record keys in
+// the kernel with setsockopt(SOL_TLS). After that the send queue leaves through the same
+// sendmsg as plaintext and the kernel encrypts it, so no user-space copy is added. A
+// kernel without the "tls" module leaves the connection on SSL_write/SSL_read.
+#ifdef WORD_TLS
+SSL_CTX* tls_context(const std::string& cert, const std::string& key) {
+    SSL_CTX* tls = SSL_CTX_new(TLS_server_method());
+    if (!tls || SSL_CTX_use_certificate_chain_file(tls, cert.c_str()) != 1 ||
+        SSL_CTX_use_PrivateKey_file(tls, key.c_str(), SSL_FILETYPE_PEM) != 1) {
+        ERR_print_errors_fp(stderr);
+        return nullptr;
+    }
+    SSL_CTX_set_options(tls, SSL_OP_ENABLE_KTLS);
+    SSL_CTX_set_num_tickets(tls, 0);  // no resumption, so nothing to send after the handshake
+    SSL_CTX_set_mode(tls, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    return tls;
+}
+
+void tls_accept(Conn* c, ServerContext& ctx) {
+    if (!ctx.tls) return;
+    c->tls.ssl = SSL_new(ctx.tls);
+    SSL_set_fd(c->tls.ssl, c->fd);
+    SSL_set_accept_state(c->tls.ssl);
+    c->tls.handshaking = true;
+}
+
+// Advance the handshake; false if it failed
+bool tls_handshake(Worker& w, Conn* c, ServerContext& ctx) {
+    int r = SSL_do_handshake(c->tls.ssl);
+    if (r != 1) {
+        int err = SSL_get_error(c->tls.ssl, r);
+        if (err == SSL_ERROR_WANT_READ) conn_set_events(w, c, EPOLLIN);
+        else if (err == SSL_ERROR_WANT_WRITE) conn_set_events(w, c, EPOLLOUT);
+        else return false;
+        return true;
+    }
+    c->tls.handshaking = false;
+    c->tls.ktls_tx = BIO_get_ktls_send(SSL_get_wbio(c->tls.ssl));
+    c->tls.ktls_rx = BIO_get_ktls_recv(SSL_get_rbio(c->tls.ssl));
+    (c->tls.ktls_tx ? ctx.telemetry.tls_kernel : ctx.telemetry.tls_user)++;
+    conn_set_events(w, c, EPOLLIN);
+    return true;
+}
+
+// Map an OpenSSL result onto read()/send() conventions
+ssize_t tls_result(Conn* c, int ok, size_t n) {
+    if (ok) return static_cast<ssize_t>(n);
+    int err = SSL_get_error(c->tls.ssl, 0);
+    if (err == SSL_ERROR_ZERO_RETURN) return 0;
+    errno = (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) ? EAGAIN : EIO;
+    return -1;
+}
+
+void tls_free(Conn* c) {
+    if (c->tls.ssl) SSL_free(c->tls.ssl);
+}
+#else
+void tls_accept(Conn*, ServerContext&) {}
+bool tls_handshake(Worker&, Conn*, ServerContext&) { return false; }
+void tls_free(Conn*) {}
+#endif
+
+// read() on the connection, through OpenSSL unless the kernel decrypts
+ssize_t conn_recv(Conn* c, char* buf, size_t len) {
+#ifdef WORD_TLS
+    if (c->tls.ssl && !c->tls.ktls_rx) {
+        size_t n = 0;
+        int ok = SSL_read_ex(c->tls.ssl, buf, len, &n);
+        return tls_result(c, ok, n);
+    }
+#endif
+    return read(c->fd, buf, len);
+}
+
+// Send from the head of the output queue, through OpenSSL unless the kernel encrypts
+ssize_t conn_send(Conn* c) {
+#ifdef WORD_TLS
+    if (c->tls.ssl && !c->tls.ktls_tx) {
+        OutBuf::Block* b = c->outbuf.first;
+        size_t n = 0;
+        int ok = SSL_write_ex(c->tls.ssl, b->bytes() + b->head, b->tail - b->head, &n);
+        if (ok) c->outbuf.drop(n);
+        return tls_result(c, ok, n);
+    }
+#endif
+    return c->outbuf.send_to(c->fd);
+}
+
+void conn_close(Worker& w, Conn* c, ServerContext& ctx) {
+    epoll_ctl(w.epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+    w.conns.erase(c->fd);
+    tracker_drop(ctx.tracker, c->fd);
+    sched_drop(ctx.sched, c->session.conn_id);
+    {
+        std::lock_guard<std::mutex> lock(ctx.telemetry.mu);
+        ctx.telemetry.conns.erase(c->session.conn_id);
+        tls_free(c);
+        close(c->fd);
+    }
+    conn_delete(c);
     // std::cout << "Client disconnected." << std::endl;
 }
 
+// Bytes of words [a, b) joined by commas
+size_t joined_size(const Corpus& words, size_t a, size_t b) {
+    size_t n = b > a ? b - a - 1 : 0;
+    if (b <= a) return n;
+    CorpusWalk walk(words, a);
+    for (size_t i = a; i < b; ++i) n += walk.next().size();
+    return n;
+}
 
-int main(int argc, char* argv[]) {
-    std::string config_path = "config.json";
-    for (int i = 1; i < argc; ++i) {
-        if (std::string(argv[i]) == "--config" && i + 1 < argc) {
-            config_path = argv[i + 1];
+std::string to_lower(std::string v) {
+    std::transform(v.begin(), v.end(), v.begin(), [](unsigned char ch) { return std::tolower(ch); });
+    return v;
+}
+
+// An HTTP/1.0 client only keeps the connection when the reply says so
+void http_status(Conn* c, int code, const char* reason, const std::string& headers) {
+    const char* connection = c->close_after ? "Connection: close\r\n" : c->http10 ? "Connection: keep-alive\r\n" : "";
+    c->outbuf.append("HTTP/1.1 " + std::to_string(code) + " " + reason + "\r\n" + headers + connection + "\r\n");
+}
+
+void http_error(Conn* c, int code, const char* reason, const std::string& headers = "") {
+    std::string body = std::string(reason) + "\n";
+    http_status(c, code, reason, headers + "Content-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\n");
+    c->outbuf.append(body);
+}
+
+// Queue the next slice of a streamed reply
+void http_stream_more(Conn* c, ServerContext& ctx) {
+    HttpStream& st = c->stream;
+    size_t b = std::min(st.end, st.next + kHttpSlice);
+    bool last = b == st.end;
+    if (st.chunked) {
+        char hex[24];
+        snprintf(hex, sizeof(hex), "%zx\r\n", joined_size(ctx.words, st.next, b) + (st.next > st.start) + last);
+        c->outbuf.append(hex, strlen(hex));
+    }
+    if (st.next > st.start) c->outbuf.append(",", 1);
+    encode_words<TextWords>(c->outbuf, ctx.words, ctx.ids, st.next, b);
+    if (last) c->outbuf.append("\n", 1);
+    if (st.chunked) c->outbuf.append(last ? "\r\n0\r\n\r\n" : "\r\n");
+    st.next = b;
+    st.active = !last;
+}
+
+// Reply with words [from, to): inline with a Content-Length, or streamed when large
+void http_words(Conn* c, ServerContext& ctx, int code, const char* reason, size_t from, size_t to, bool http10, std::string headers) {
+    headers += "Content-Type: text/plain\r\nAccept-Ranges: words\r\n";
+    if (to - from <= kHttpSlice) {
+        http_status(c, code, reason, headers + "Content-Length: " + std::to_string(joined_size(ctx.words, from, to) + 1) + "\r\n");
+        encode_words<TextWords>(c->outbuf, ctx.words, ctx.ids, from, to);
+        c->outbuf.append("\n", 1);
+        return;
+    }
+    c->stream = HttpStream{from, from, to, true, !http10};
+    if (http10) c->close_after = true;
+    http_status(c, code, reason, headers + (http10 ? "" : "Transfer-Encoding: chunked\r\n"));
+    http_stream_more(c, ctx);
+}
+
+// Under a scheduler an HTTP request for words waits its turn like a "p,k" request: false
+// (nothing answered, the head left for another try) until the scheduler admits it
+bool http_admit(Conn* c, ServerContext& ctx, size_t p, size_t k) {
+    if (ctx.sched.policy == SchedPolicy::None) return true;
+    if (c->admitted) {
+        c->admitted = false;
+        return true;
+    }
+    SchedRequest r{c->session.worker, c->fd, c->session.conn_id, static_cast<int>(std::min<size_t>(p, INT32_MAX)),
+                   static_cast<int>(std::min<size_t>(k, INT32_MAX)), nullptr};
+    r.job = SchedJob::Admit;
+    sched_queue(c->session, ctx, r);
+    c->waiting = true;
+    c->close_after = false;  // decided again when the request is answered
+    return false;
+}
+
+// "words=p-q" or "words=p-" -> first and last word; false if it is not a words range
+bool parse_word_range(const std::string& value, size_t size, size_t& from, size_t& last) {
+    if (value.compare(0, 6, "words=") != 0 || value.find(',') != std::string::npos) return false;
+    size_t dash = value.find('-', 6);
+    if (dash == std::string::npos || dash == 6) return false;
+    try {
+        from = std::stoull(value.substr(6, dash - 6));
+        last = dash + 1 < value.size() ? std::stoull(value.substr(dash + 1)) : (size ? size - 1 : 0);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return from <= last;
+}
+
+// Answer one request whose head (request line and headers) is complete
+void http_request(Conn* c, ServerContext& ctx, const std::string& head) {
+    c->http10 = false;
+    std::vector<std::string> lines;
+    size_t start = 0, nl;
+    while ((nl = head.find('\n', start)) != std::string::npos) {
+        size_t end = (nl > start && head[nl - 1] == '\r') ? nl - 1 : nl;
+        if (end > start) lines.push_back(head.substr(start, end - start));
+        start = nl + 1;
+    }
+    size_t sp1 = lines.empty() ? std::string::npos : lines[0].find(' ');
+    size_t sp2 = lines.empty() ? std::string::npos : lines[0].rfind(' ');
+    if (sp1 == std::string::npos || sp1 == sp2) {
+        c->close_after = true;
+        return http_error(c, 400, "Bad Request");
+    }
+    std::string method = lines[0].substr(0, sp1);
+    std::string target = lines[0].substr(sp1 + 1, sp2 - sp1 - 1);
+    bool http10 = c->http10 = lines[0].compare(sp2 + 1, std::string::npos, "HTTP/1.0") == 0;
+    std::map<std::string, std::string> headers;
+    for (size_t i = 1; i < lines.size(); ++i) {
+        size_t colon = lines[i].find(':');
+        if (colon == std::string::npos) continue;
+        size_t value = lines[i].find_first_not_of(" \t", colon + 1);
+        headers[to_lower(lines[i].substr(0, colon))] = value == std::string::npos ? "" : lines[i].substr(value);
+    }
+    std::string connection = to_lower(headers["connection"]);
+    c->close_after = http10 ? connection != "keep-alive" : connection == "close";
+
+    // No request bodies: with one we could not find where the next request starts
+    if ((headers.count("content-length") && headers["content-length"] != "0") || headers.count("transfer-encoding")) {
+        c->close_after = true;
+        return http_error(c, 400, "Bad Request");
+    }
+    if (method != "GET") return http_error(c, 405, "Method Not Allowed", "Allow: GET\r\n");
+    size_t qmark = target.find('?');
+    if (target.substr(0, qmark) != "/words") return http_error(c, 404, "Not Found");
+
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"%016llx\"", static_cast<unsigned long long>(ctx.version));
+    std::string tag_header = std::string("ETag: ") + etag + "\r\n";
+    if (headers.count("if-none-match") && headers["if-none-match"] == etag) return http_status(c, 304, "Not Modified", tag_header);
+
+    size_t size = ctx.words.size();
+    std::string unsatisfiable = "Content-Range: words */" + std::to_string(size) + "\r\n";
+    if (qmark != std::string::npos) {
+        // "?p=..&k=..": the same range as a "p,k" request
+        std::map<std::string, std::string> params;
+        std::string query = target.substr(qmark + 1);
+        size_t pos = 0;
+        while (pos <= query.size()) {
+            size_t amp = query.find('&', pos);
+            if (amp == std::string::npos) amp = query.size();
+            std::string param = query.substr(pos, amp - pos);
+            size_t eq = param.find('=');
+            if (eq != std::string::npos) params[param.substr(0, eq)] = param.substr(eq + 1);
+            pos = amp + 1;
+        }
+        long long p, k;
+        try {
+            p = std::stoll(params.at("p"));
+            k = std::stoll(params.at("k"));
+        } catch (const std::exception&) {
+            return http_error(c, 400, "Bad Request");
         }
+        if (p < 0 || k < 0) return http_error(c, 400, "Bad Request");
+        if (static_cast<size_t>(p) >= size) return http_error(c, 416, "Range Not Satisfiable", unsatisfiable);
+        // k is the client's: compare it with what is left rather than form p + k, which can overflow
+        bool eof = static_cast<size_t>(k) > size - p;
+        size_t to = eof ? size : p + k;
+        if (!http_admit(c, ctx, p, to - p)) return;
+        ctx.trace.record(c->session.conn_id, p, k);
+        return http_words(c, ctx, 200, "OK", p, to, http10, tag_header + (eof ? "X-Words-EOF: 1\r\n" : ""));
+    }
+    size_t from, last;
+    if (headers.count("range") && parse_word_range(headers["range"], size, from, last)) {
+        if (from >= size) return http_error(c, 416, "Range Not Satisfiable", unsatisfiable);
+        last = std::min(last, size - 1);
+        if (!http_admit(c, ctx, from, last - from + 1)) return;
+        ctx.trace.record(c->session.conn_id, from, last - from + 1);
+        return http_words(c, ctx, 206, "Partial Content", from, last + 1, http10,
+                          tag_header + "Content-Range: words " + std::to_string(from) + "-" + std::to_string(last) + "/" + std::to_string(size) + "\r\n");
     }
+    // No query and no (usable) Range: the whole corpus
+    if (!http_admit(c, ctx, 0, size)) return;
+    http_words(c, ctx, 200, "OK", 0, size, http10, tag_header);
+}
 
-    auto config = parse_config(config_path);
-    if (config.find("server_port") == config.end() || config.find("filename") == config.end()) {
-        std::cerr << "Error: Missing required config parameters." << std::endl;
-        return 1;
+// Length of the request head at data (through the blank line), or 0 if incomplete
+size_t http_header_end(const char* data, size_t len) {
+    const char* end = data + len;
+    for (const char* p = data; (p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr; ++p) {
+        if (p + 1 < end && p[1] == '\n') return p + 2 - data;
+        if (p + 2 < end && p[1] == '\r' && p[2] == '\n') return p + 3 - data;
     }
-    
-    int port = std::stoi(config["server_port"]);
-    std::string filename = config["filename"];
-    std::vector<std::string> words = read_words(filename);
-    
+    return 0;
+}
+
+// Answer every complete request in inbuf in order, stopping behind a streamed reply
+void http_process(Conn* c, ServerContext& ctx) {
+    size_t start = 0;
+    while (!c->stream.active && !c->close_after && !c->waiting && start < c->inbuf.len) {
+        size_t head_len = http_header_end(c->inbuf.data + start, c->inbuf.len - start);
+        if (head_len == 0) {
+            if (c->inbuf.len - start > kHttpMaxHeader) {
+                c->close_after = true;
+                http_error(c, 431, "Request Header Fields Too Large");
+                start = c->inbuf.len;
+            }
+            break;
+        }
+        http_request(c, ctx, std::string(c->inbuf.data + start, head_len));
+        if (c->waiting) break;
+        ctx.telemetry.requests++;
+        start += head_len;
+    }
+    if (start) c->inbuf.consume(start);
+}
+
+// Write as much pending output as the socket takes; false if the connection failed
+// or has sent its last reply
+bool conn_flush(Worker& w, Conn* c, ServerContext& ctx) {
+    while (true) {
+        // Streamed HTTP replies are produced a slice at a time as the queue drains
+        if (c->stream.active && c->outbuf.size < kBlockClass[kNumClasses - 1]) http_stream_more(c, ctx);
+        // Requests pipelined behind a finished stream were held back until now
+        else if (c->http && c->outbuf.empty() && c->inbuf.len && !c->close_after) http_process(c, ctx);
+        if (c->outbuf.empty()) break;
+        ssize_t n = conn_send(c);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n <= 0) return false;
+        c->load += n;
+        w.window_bytes += n;
+        ctx.telemetry.bytes_sent += n;
+    }
+    if (c->outbuf.empty() && c->close_after) return false;
+    // Stop reading while output is backed up so a pipelining client cannot grow it unbounded
+    conn_set_events(w, c, c->outbuf.empty() ? EPOLLIN : EPOLLOUT);
+    return true;
+}
+
+// Requests are newline-terminated; several may arrive in one read
+void conn_process(Conn* c, ServerContext& ctx) {
+    if (c->inbuf.len == 0) return;
+    if (c->http) return http_process(c, ctx);
+    Session& s = c->session;
+    const char* data = c->inbuf.data;
+    size_t start = 0;
+    const char* line_end;
+    while ((line_end = static_cast<const char*>(memchr(data + start, '\n', c->inbuf.len - start))) != nullptr) {
+        std::string req(data + start, line_end - (data + start));
+        start = line_end - data + 1;
+        if (!req.empty() && req.back() == '\r') req.pop_back();
+        if (req.empty()) continue;
+        ctx.telemetry.requests++;
+        // Behind a scheduled reply that is not back yet, an inline reply waits its turn
+        OutBuf held;
+        OutBuf& out = s.replies_sent == s.replies_issued ? c->outbuf : held;
+        try {
+            handle_request(req, s, ctx, out);
+        } catch (const std::exception& e) {
+            out.append("EOF\n", 4); // Send EOF for any parsing errors
+        }
+        if (!held.empty()) s.held[s.replies_issued++].splice(held);
+    }
+    if (start) c->inbuf.consume(start);
+}
+
+// Read what is available, answer complete requests and flush; false once the
+// connection is finished
+bool conn_readable(Worker& w, Conn* c, ServerContext& ctx) {
+    ssize_t bytes_read;
+    while (true) {
+        // Read straight into the connection's pooled buffer
+        c->inbuf.reserve(1024);
+        size_t room = c->inbuf.cap - c->inbuf.len;
+        bytes_read = conn_recv(c, c->inbuf.data + c->inbuf.len, room);
+        if (bytes_read <= 0) break;
+        c->inbuf.len += bytes_read;
+        if (bytes_read < static_cast<ssize_t>(room)) break;
+    }
+    if (c->inbuf.len == 0) c->inbuf.release();
+    if (bytes_read == 0 || (bytes_read < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        // Client closed connection or error occurred
+        return false;
+    }
+    conn_process(c, ctx);
+    if (!conn_flush(w, c, ctx)) return false;
+    if (ctx.sched.policy == SchedPolicy::None) read_ahead(c->session.cursor, ctx.words, ctx.ids, c->session.mode->encode);
+    if (ctx.tuning.autotune && ++c->session.requests_since_tune >= ctx.tuning.autotune_every) {
+        autotune_buffers(c->fd, ctx.tuning.pacing_rate);
+        c->session.requests_since_tune = 0;
+    }
+    return true;
+}
+
+void conn_accept(Worker& w, ServerContext& ctx, int listen_fd, bool http) {
+    while (true) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int new_socket = accept4(listen_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK);
+        if (new_socket < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept");
+            return;
+        }
+        // std::cout << "Client connected." << std::endl;
+        char ip[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+        Conn* c = conn_new(new_socket, ip, ctx.next_conn++);
+        if (ctx.tuning.pacing_rate) apply_weight(new_socket, ctx.tuning, 1.0);
+        {
+            std::lock_guard<std::mutex> lock(ctx.telemetry.mu);
+            ctx.telemetry.conns[c->session.conn_id] = new_socket;
+        }
+        c->http = http;
+        c->session.worker = w.id;
+        if (ctx.sched.policy != SchedPolicy::None) {
+            // Scheduled replies trickle out one by one; Nagle would hold each behind the last ACK
+            int one = 1;
+            setsockopt(new_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        tls_accept(c, ctx);
+        w.conns[new_socket] = c;
+        conn_set_events(w, c, EPOLLIN);
+    }
+}
+
+// Take over connections migrated from other workers
+void adopt_inbox(Worker& w) {
+    uint64_t count;
+    ssize_t ignored = read(w.wake_fd, &count, sizeof(count));
+    (void)ignored;
+    std::vector<Conn*> moved;
+    {
+        std::lock_guard<std::mutex> lock(w.inbox_mu);
+        moved.swap(w.inbox);
+    }
+    for (Conn* c : moved) {
+        w.conns[c->fd] = c;
+        c->session.worker = w.id;
+        uint32_t events = c->events;
+        c->events = 0;
+        conn_set_events(w, c, events ? events : EPOLLIN);
+    }
+}
+
+// Queue replies from the request scheduler on their connections
+void deliver_replies(Worker& w, ServerContext& ctx) {
+    if (ctx.sched.policy == SchedPolicy::None) return;
+    std::deque<SchedReply> replies;
+    {
+        SchedOutbox& box = *ctx.sched.outboxes[w.id];
+        std::lock_guard<std::mutex> lock(box.mu);
+        replies.swap(box.replies);
+    }
+    // Queue everything first so a connection's replies leave in one send
+    std::vector<Conn*> touched;
+    for (auto& r : replies) {
+        auto it = w.conns.find(r.fd);
+        if (it == w.conns.end() || it->second->session.conn_id != r.conn_id) continue;  // closed meanwhile
+        Conn* c = it->second;
+        if (c->outbuf.empty() && std::find(touched.begin(), touched.end(), c) == touched.end()) touched.push_back(c);
+        if (c->http) {
+            // The flush answers the admitted request
+            c->waiting = false;
+            c->admitted = true;
+            continue;
+        }
+        // Replies leave in request order; one that overtook an earlier one waits for it
+        Session& s = c->session;
+        s.held[r.reply].splice(r.out);
+        for (auto h = s.held.begin(); h != s.held.end() && h->first == s.replies_sent; h = s.held.erase(h)) {
+            c->outbuf.splice(h->second);
+            s.replies_sent++;
+        }
+    }
+    for (Conn* c : touched) {
+        if (!conn_flush(w, c, ctx)) conn_close(w, c, ctx);
+    }
+}
+
+void migrate(Worker& from, Worker& to, Conn* c, ServerContext& ctx) {
+    epoll_ctl(from.epfd, EPOLL_CTL_DEL, c->fd, nullptr);
+    from.conns.erase(c->fd);
+    {
+        std::lock_guard<std::mutex> lock(to.inbox_mu);
+        to.inbox.push_back(c);
+    }
+    uint64_t one = 1;
+    ssize_t ignored = write(to.wake_fd, &one, sizeof(one));
+    (void)ignored;
+    ctx.telemetry.migrations++;
+}
+
+void rebalance(Worker& w, Balancer& bal, ServerContext& ctx) {
+    w.load = w.window_bytes;
+    w.window_bytes = 0;
+    Conn* heaviest = nullptr;
+    for (auto& entry : w.conns) {
+        if (!heaviest || entry.second->load > heaviest->load) heaviest = entry.second;
+    }
+    uint64_t total = 0;
+    Worker* lightest = nullptr;
+    for (auto& other : bal.workers) {
+        total += other->load;
+        if (!lightest || other->load < lightest->load) lightest = other.get();
+    }
+    double mean = static_cast<double>(total) / bal.workers.size();
+    // Only move a connection if the target stays lighter than we are now
+    if (heaviest && w.conns.size() > 1 && lightest != &w && w.load > bal.balance_ratio * mean &&
+        lightest->load + heaviest->load < w.load) {
+        lightest->load += heaviest->load;
+        w.load -= heaviest->load;
+        migrate(w, *lightest, heaviest, ctx);
+    }
+    for (auto& entry : w.conns) entry.second->load = 0;
+}
+
+void worker_loop(Worker& w, Balancer& bal, ServerContext& ctx) {
+    ctx.tasks.enter();
+    struct epoll_event events[64];
+    auto last_balance = std::chrono::steady_clock::now();
+    while (true) {
+        int n = epoll_wait(w.epfd, events, 64, bal.balance_ms > 0 ? bal.balance_ms : -1);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == w.listen_fd) { conn_accept(w, ctx, w.listen_fd, false); continue; }
+            if (fd == w.http_fd) { conn_accept(w, ctx, w.http_fd, true); continue; }
+            if (fd == w.wake_fd) {
+                adopt_inbox(w);
+                deliver_replies(w, ctx);
+                continue;
+            }
+            auto it = w.conns.find(fd);
+            if (it == w.conns.end()) continue;
+            Conn* c = it->second;
+            if (c->tls.handshaking) {
+                // Requests sent right behind the client's Finished may already be waiting
+                if (!tls_handshake(w, c, ctx) || (!c->tls.handshaking && !conn_readable(w, c, ctx))) conn_close(w, c, ctx);
+                continue;
+            }
+            bool ok = true;
+            if (events[i].events & EPOLLOUT) {
+                ok = conn_flush(w, c, ctx);
+                // Drained: answer requests that arrived while output was backed up
+                if (ok && c->outbuf.empty() && c->inbuf.len && memchr(c->inbuf.data, '\n', c->inbuf.len)) {
+                    conn_process(c, ctx);
+                    ok = conn_flush(w, c, ctx);
+                }
+            }
+            if (ok && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) ok = conn_readable(w, c, ctx);
+            if (!ok) conn_close(w, c, ctx);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (bal.balance_ms > 0 && bal.workers.size() > 1 && now - last_balance >= std::chrono::milliseconds(bal.balance_ms)) {
+            rebalance(w, bal, ctx);
+            last_balance = now;
+        }
+    }
+}
+
+// Listening socket for one worker; every worker binds the same port with SO_REUSEPORT
+int make_listener(int port, const std::string& congestion) {
     int server_fd;
     struct sockaddr_in address;
     int opt = 1;
-    socklen_t addrlen = sizeof(address);
 
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) < 0) {
         perror("socket failed");
         exit(EXIT_FAILURE);
     }
 
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
         perror("setsockopt");
         exit(EXIT_FAILURE);
     }
-    
+
+    // "congestion": algorithm for every accepted connection (inherited from the listener)
+    if (!congestion.empty() && setsockopt(server_fd, IPPROTO_TCP, TCP_CONGESTION, congestion.c_str(), congestion.size()) < 0) {
+        perror("congestion");
+        exit(EXIT_FAILURE);
+    }
+
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY; // Listen on all available interfaces
     address.sin_port = htons(port);
@@ -148,22 +2422,176 @@ int main(int argc, char* argv[]) {
         exit(EXIT_FAILURE);
     }
 
-    if (listen(server_fd, 10) < 0) {
+    if (listen(server_fd, 128) < 0) {
         perror("listen");
         exit(EXIT_FAILURE);
     }
+    return server_fd;
+}
 
-    std::cout << "Server listening on port " << port << std::endl;
 
-    while (true) {
-        int new_socket;
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, &addrlen)) < 0) {
-            perror("accept");
-            continue; // Continue to next iteration
+int main(int argc, char* argv[]) {
+    std::string config_path = "config.json";
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--config" && i + 1 < argc) {
+            config_path = argv[i + 1];
         }
-        // std::cout << "Client connected." << std::endl;
-        handle_client(new_socket, words);
     }
 
+    auto config = parse_config(config_path);
+    if (config.find("server_port") == config.end() || config.find("filename") == config.end()) {
+        std::cerr << "Error: Missing required config parameters." << std::endl;
+        return 1;
+    }
+    
+    int port = std::stoi(config["server_port"]);
+    std::string filename = config["filename"];
+    // SIGINT/SIGTERM are handled by a dedicated thread so the trace can be flushed on exit
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    static ServerContext ctx;
+    // "filename" may also be a directory or a glob of corpus shards. Tokenizing:
+    // "delimiters", "trim", "validate_utf8"; COUNT case folding: "fold_case" (ascii, unicode)
+    auto flag = [&config](const std::string& key) { return config.count(key) && config[key] != "false" && config[key] != "0"; };
+    if (config["fold_case"] == "ascii") ctx.fold = CaseFold::Ascii;
+    else if (config["fold_case"] == "unicode") ctx.fold = CaseFold::Unicode;
+    else if (!config["fold_case"].empty() && config["fold_case"] != "none") {
+        std::cerr << "Error: unknown fold_case " << config["fold_case"] << std::endl;
+        return 1;
+    }
+    try {
+        ctx.words = load_corpus(filename, make_tokenizer(config["delimiters"], flag("trim"), flag("validate_utf8")));
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    ctx.version = ctx.words.version;
+    if (config.count("block_words")) ctx.block_avg = std::stoi(config["block_words"]);
+
+    // Optional multicast push: "mcast_group", "mcast_port", "mcast_if", "mcast_wait_ms", "mcast_pace_us"
+    if (config.count("mcast_group")) {
+        Multicast& mc = ctx.mcast;
+        mc.enabled = true;
+        mc.group = config["mcast_group"];
+        mc.port = config.count("mcast_port") ? std::stoi(config["mcast_port"]) : port + 1;
+        if (config.count("mcast_if")) mc.iface = config["mcast_if"];
+        if (config.count("mcast_wait_ms")) mc.wait_ms = std::stoi(config["mcast_wait_ms"]);
+        if (config.count("mcast_pace_us")) mc.pace_us = std::stoi(config["mcast_pace_us"]);
+        mc.packets = make_packets(ctx.words, 1400);
+        std::thread(multicast_sender, std::ref(mc)).detach();
+    }
+    
+    // Optional transport tuning: "pacing_rate" (bytes/s), "autotune_buffers", "autotune_every"
+    if (config.count("pacing_rate")) ctx.tuning.pacing_rate = std::stoull(config["pacing_rate"]);
+    if (config.count("autotune_buffers")) ctx.tuning.autotune = config["autotune_buffers"] != "0" && config["autotune_buffers"] != "false";
+    if (config.count("autotune_every")) ctx.tuning.autotune_every = std::max(1, std::stoi(config["autotune_every"]));
+
+    // Pool caches: "block_cache" blocks per size class and "conn_cache" Conn slots, per thread
+    if (config.count("block_cache")) block_cache_limit = std::stoul(config["block_cache"]);
+    if (config.count("conn_cache")) conn_cache_limit = std::stoul(config["conn_cache"]);
+
+    // Optional TLS: "tls_cert" and "tls_key" (PEM files, e.g. from make certs)
+    if (config.count("tls_cert")) {
+#ifdef WORD_TLS
+        ctx.tls = tls_context(config["tls_cert"], config["tls_key"]);
+        if (!ctx.tls) exit(EXIT_FAILURE);
+#else
+        std::cerr << "Error: tls_cert needs a build with make TLS=1" << std::endl;
+        return 1;
+#endif
+    }
+
+    if (config.count("trace_file") && !ctx.trace.open_file(config["trace_file"])) {
+        perror("trace_file");
+        exit(EXIT_FAILURE);
+    }
+    std::thread([stop_signals]() {
+        int sig;
+        sigwait(&stop_signals, &sig);
+        ctx.trace.flush();
+        _exit(0);
+    }).detach();
+
+    // Event loop workers: "workers" (default: one per CPU), "balance_ms", "balance_ratio";
+    // with "http_port" each worker also takes HTTP connections
+    int http_port = config.count("http_port") ? std::stoi(config["http_port"]) : 0;
+    static Balancer bal;
+    int num_workers = config.count("workers") ? std::stoi(config["workers"]) : static_cast<int>(std::thread::hardware_concurrency());
+    if (config.count("balance_ms")) bal.balance_ms = std::stoi(config["balance_ms"]);
+    if (config.count("balance_ratio")) bal.balance_ratio = std::stod(config["balance_ratio"]);
+    for (int i = 0; i < std::max(1, num_workers); ++i) {
+        auto w = std::make_unique<Worker>();
+        w->id = i;
+        w->epfd = epoll_create1(0);
+        w->listen_fd = make_listener(port, config["congestion"]);
+        w->wake_fd = eventfd(0, EFD_NONBLOCK);
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = w->listen_fd;
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listen_fd, &ev);
+        ev.data.fd = w->wake_fd;
+        epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->wake_fd, &ev);
+        if (http_port) {
+            w->http_fd = make_listener(http_port, config["congestion"]);
+            ev.data.fd = w->http_fd;
+            epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->http_fd, &ev);
+        }
+        bal.workers.push_back(std::move(w));
+    }
+    {
+        char ca[16] = {0};  // TCP_CA_NAME_MAX
+        socklen_t ca_len = sizeof(ca);
+        getsockopt(bal.workers[0]->listen_fd, IPPROTO_TCP, TCP_CONGESTION, ca, &ca_len);
+        ctx.telemetry.congestion = ca;
+    }
+
+    // Request scheduling: "scheduler" ("fcfs", "rr", "edf" or "srpt"), "service_us", "service_jitter_us";
+    // for edf also "default_class", "deadline_ms" and "aging_ms" (0: no aging), for srpt "max_wait_ms"
+    if (config["scheduler"] == "fcfs") ctx.sched.policy = SchedPolicy::Fcfs;
+    else if (config["scheduler"] == "rr") ctx.sched.policy = SchedPolicy::RoundRobin;
+    else if (config["scheduler"] == "edf") ctx.sched.policy = SchedPolicy::Edf;
+    else if (config["scheduler"] == "srpt") ctx.sched.policy = SchedPolicy::Srpt;
+    else if (!config["scheduler"].empty() && config["scheduler"] != "none") {
+        std::cerr << "Error: unknown scheduler " << config["scheduler"] << std::endl;
+        return 1;
+    }
+    if (config.count("service_us")) ctx.sched.service_us = std::stoi(config["service_us"]);
+    if (config.count("service_jitter_us")) ctx.sched.jitter_us = std::stoi(config["service_jitter_us"]);
+    if (config.count("default_class")) ctx.sched.default_class = std::stoi(config["default_class"]);
+    if (config.count("deadline_ms")) ctx.sched.deadline_ms = std::stoi(config["deadline_ms"]);
+    if (config.count("aging_ms")) ctx.sched.aging_ms = std::stoi(config["aging_ms"]);
+    if (config.count("max_wait_ms")) ctx.sched.max_wait_ms = std::stoi(config["max_wait_ms"]);
+    if (ctx.sched.default_class < 0 || ctx.sched.default_class >= kSchedClasses) {
+        std::cerr << "Error: default_class must be 0.." << kSchedClasses - 1 << std::endl;
+        return 1;
+    }
+
+    // Helper threads for split requests: "task_threads" (default: one per CPU), "task_chunk" words per task
+    int task_threads = config.count("task_threads") ? std::stoi(config["task_threads"]) : static_cast<int>(std::thread::hardware_concurrency());
+    if (config.count("task_chunk")) ctx.tasks.chunk_words = std::max(1, std::stoi(config["task_chunk"]));
+    // One deque per thread that splits work: workers, helpers and the scheduler (COUNT)
+    ctx.tasks.init(static_cast<int>(bal.workers.size()) + std::max(0, task_threads) + (ctx.sched.policy != SchedPolicy::None));
+
+    if (ctx.sched.policy != SchedPolicy::None) {
+        bal.balance_ms = 0;
+        for (auto& w : bal.workers) {
+            ctx.sched.outboxes.push_back(std::make_unique<SchedOutbox>());
+            ctx.sched.outboxes.back()->wake_fd = w->wake_fd;
+        }
+        std::thread(scheduler_loop, std::ref(ctx.sched), std::ref(ctx)).detach();
+    }
+
+    std::cout << "Server listening on port " << port << std::endl;
+    if (http_port) std::cout << "HTTP listening on port " << http_port << std::endl;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < task_threads; ++i) threads.emplace_back([] { ctx.tasks.helper_loop(); });
+    for (auto& w : bal.workers) threads.emplace_back(worker_loop, std::ref(*w), std::ref(bal), std::ref(ctx));
+    for (auto& t : threads) t.join();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+// tcp_info.h
+// TCP_INFO sampling shared by server.cpp ("STATS") and client.cpp (--stats), so both
+// report a connection in the same JSON shape
+#ifndef TCP_INFO_H
+#define TCP_INFO_H
+
+#include <cstdio>
+#include <string>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h>
+
+// TCP_INFO of one socket as a JSON object
+inline std::string tcp_info_json(int sock) {
+    struct tcp_info info;
+    socklen_t len = sizeof(info);
+    char ca[16] = {0};  // TCP_CA_NAME_MAX
+    socklen_t ca_len = sizeof(ca);
+    if (getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &len) < 0) return "{}";
+    getsockopt(sock, IPPROTO_TCP, TCP_CONGESTION, ca, &ca_len);
+    char out[320];
+    snprintf(out, sizeof(out),
+             "{\"ca\":\"%s\",\"rtt_us\":%u,\"rttvar_us\":%u,\"cwnd\":%u,\"ssthresh\":%u,\"retransmits\":%u,"
+             "\"total_retrans\":%u,\"delivery_rate\":%llu,\"pacing_rate\":%llu}",
+             ca, info.tcpi_rtt, info.tcpi_rttvar, info.tcpi_snd_cwnd, info.tcpi_snd_ssthresh, info.tcpi_retransmits,
+             info.tcpi_total_retrans, static_cast<unsigned long long>(info.tcpi_delivery_rate),
+             static_cast<unsigned long long>(info.tcpi_pacing_rate));
+    return out;
+}
+
+#endif
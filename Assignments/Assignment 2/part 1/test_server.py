@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+# End-to-end checks for the C++ server: each test writes a corpus and a config into a
+# temporary directory, starts ./server on a free port and talks to it over TCP.
+# Run with: make test (gzip cases need a ZLIB=1 build and are skipped otherwise)
+
+import gzip
+import json
+import os
+import socket
+import subprocess
+import tempfile
+import time
+import unittest
+from collections import Counter
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SERVER = os.path.join(HERE, 'server')
+CLIENT = os.path.join(HERE, 'client')
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(('127.0.0.1', 0))
+        return s.getsockname()[1]
+
+
+class ServerCase(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.proc = None
+
+    def tearDown(self):
+        self.stop()
+        self.dir.cleanup()
+
+    def stop(self):
+        if self.proc:
+            self.proc.terminate()
+            self.proc.wait()
+            self.proc.stdout.close()
+            self.proc = None
+
+    def path(self, name):
+        return os.path.join(self.dir.name, name)
+
+    def start(self, filename, **options):
+        """Start the server on filename; returns its output if it exits instead."""
+        self.port = free_port()
+        config = {'server_ip': '127.0.0.1', 'server_port': self.port, 'filename': filename, 'workers': 1}
+        config.update(options)
+        with open(self.path('config.json'), 'w') as f:
+            json.dump(config, f, indent=2)  # parse_config reads one key per line
+        self.proc = subprocess.Popen([SERVER, '--config', self.path('config.json')],
+                                     stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+        output = []
+        for line in self.proc.stdout:
+            output.append(line)
+            if 'listening' in line:
+                return None
+        self.proc.wait()
+        self.proc.stdout.close()
+        self.proc = None
+        return ''.join(output)
+
+    def client_counts(self, *args, **options):
+        """Run ./client against the server; its "word,count" lines as a dict."""
+        config = {'server_ip': '127.0.0.1', 'server_port': self.port, 'k': 5, 'p': 0, 'num_iterations': 1}
+        config.update(options)
+        with open(self.path('client.json'), 'w') as f:
+            json.dump(config, f, indent=2)
+        out = subprocess.run([CLIENT, '--config', self.path('client.json')] + list(args),
+                             stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, timeout=30, check=True).stdout
+        counts = {}
+        for line in out.decode().splitlines():
+            word, _, count = line.rpartition(',')
+            if not line.startswith('ELAPSED_MS:'):
+                counts[word] = int(count)
+        return counts
+
+    def lines(self, *requests, replies=None):
+        """Send requests on one connection and read one reply line per request (or
+        `replies` lines, for requests that have none)."""
+        with socket.create_connection(('127.0.0.1', self.port), timeout=5) as s:
+            s.sendall(''.join(r + '\n' for r in requests).encode())
+            f = s.makefile('rb')
+            return [f.readline().decode().rstrip('\n') for _ in range(len(requests) if replies is None else replies)]
+
+
+class CorpusTest(ServerCase):
+    def test_gzip_shards_with_newline_delimiter(self):
+        os.mkdir(self.path('shards'))
+        shards = [['alpha', 'beta'], ['gamma'], ['delta', 'epsilon', 'zeta']]
+        for i, words in enumerate(shards):
+            with gzip.open(self.path('shards/part-%d.gz' % i), 'wt') as f:
+                f.write('\n'.join(words) + '\n')
+        error = self.start(self.path('shards'), delimiters='\n')
+        if error and 'ZLIB=1' in error:
+            self.skipTest('server built without ZLIB=1')
+        self.assertIsNone(error, error)
+        words = [w for shard in shards for w in shard]
+        self.assertEqual(self.lines('0,100'), [','.join(words) + ',EOF'])
+        self.assertEqual(self.lines('5,1', '6,1'), ['zeta', 'EOF'])
+
+    def test_shipped_words_count_the_same_in_text_and_binary(self):
+        # words.txt ends with a newline, which ends the file rather than the last word
+        shipped = os.path.join(HERE, 'words.txt')
+        self.assertIsNone(self.start(shipped))
+        with open(shipped) as f:
+            expected = dict(Counter(f.read().rstrip('\n').split(',')))
+        self.assertEqual(self.client_counts(), expected)
+        self.assertEqual(self.client_counts('--mode', 'binary'), expected)
+
+    def test_validate_utf8_refuses_malformed_corpora(self):
+        cases = [('overlong', b'ok,\xc0\xaf'), ('surrogate', b'ok,\xed\xa0\x80'),
+                 ('past_max', b'ok,\xf4\x90\x80\x80'), ('truncated', b'ok,\xe2\x82')]
+        for name, payload in cases:
+            with open(self.path(name), 'wb') as f:
+                f.write(payload)
+            error = self.start(self.path(name), validate_utf8=True)
+            self.assertIsNotNone(error, name + ' loaded')
+            self.assertIn('invalid UTF-8', error)
+        # Without the check the bytes are served as they are
+        self.assertIsNone(self.start(self.path('overlong')))
+        self.stop()
+        with open(self.path('valid'), 'wb') as f:
+            f.write('ok,été,σοφια,\U0001f600'.encode())
+        self.assertIsNone(self.start(self.path('valid'), validate_utf8=True))
+
+    def test_trim_strips_whitespace_in_text_and_binary(self):
+        with open(self.path('trim.txt'), 'w') as f:
+            f.write(' a ,\tb\r, c c ,  ,d\n')
+        self.assertIsNone(self.start(self.path('trim.txt'), trim=True))
+        self.assertEqual(self.lines('0,10', 'COUNT 0,10'), ['a,b,c c,,d,EOF', 'a:1,b:1,c c:1,d:1'])
+        expected = self.client_counts()
+        self.assertEqual(expected, {'a': 1, 'b': 1, 'c c': 1, 'd': 1})
+        self.assertEqual(self.client_counts('--mode', 'binary'), expected)
+
+    def test_fold_case_counts_ascii_and_unicode(self):
+        with open(self.path('fold.txt'), 'w', encoding='utf-8') as f:
+            f.write('Apple,APPLE,apple,Éclair,éclair,ΣΟΦΙΑ,σοφια')
+        # ASCII folding leaves other scripts alone; the words themselves are served unfolded
+        self.assertIsNone(self.start(self.path('fold.txt'), fold_case='ascii'))
+        self.assertEqual(self.lines('0,2', 'COUNT 0,7'),
+                         ['Apple,APPLE', 'apple:3,Éclair:1,éclair:1,ΣΟΦΙΑ:1,σοφια:1'])
+        self.stop()
+        self.assertIsNone(self.start(self.path('fold.txt'), fold_case='unicode'))
+        self.assertEqual(self.lines('COUNT 0,7'), ['apple:3,éclair:2,σοφια:2'])
+
+    def test_damaged_gzip_fails_at_load(self):
+        data = gzip.compress(','.join('w%d' % i for i in range(20000)).encode())
+        corrupt = bytearray(data)
+        corrupt[len(data) // 2] ^= 0xff
+        for name, payload in [('truncated.gz', data[:len(data) // 2]), ('corrupt.gz', bytes(corrupt))]:
+            with open(self.path(name), 'wb') as f:
+                f.write(payload)
+            error = self.start(self.path(name))
+            if error and 'ZLIB=1' in error:
+                self.skipTest('server built without ZLIB=1')
+            self.assertIsNotNone(error, name + ' loaded')
+            self.assertIn('Error: ' + self.path(name), error)
+
+
+class ProtocolTest(ServerCase):
+    def setUp(self):
+        super().setUp()
+        with open(self.path('words.txt'), 'w') as f:
+            f.write('a,b,c,d,e')
+
+    def test_weight_never_replies(self):
+        # No "pacing_rate": WEIGHT is ignored, and a malformed one too
+        self.assertIsNone(self.start(self.path('words.txt')))
+        self.assertEqual(self.lines('WEIGHT 2', 'WEIGHT abc', '0,2', replies=1), ['a,b'])
+
+    def test_cursor_past_the_end_stays_at_eof(self):
+        # A 2^30-word step wraps a 32-bit position back to 0 after four NEXTs
+        self.assertIsNone(self.start(self.path('words.txt')))
+        replies = self.lines('OPEN 0,1073741824', *['NEXT'] * 5)
+        self.assertTrue(replies[0].startswith('OK '), replies[0])
+        self.assertEqual(replies[1:], ['a,b,c,d,e,EOF'] + ['EOF'] * 4)
+
+    def test_next_rejects_a_count_below_one(self):
+        self.assertIsNone(self.start(self.path('words.txt')))
+        replies = self.lines('OPEN 0,2', 'NEXT 0', 'NEXT -1', 'NEXT')
+        self.assertEqual(replies[1:], ['ERR next', 'ERR next', 'a,b'])
+
+    def test_binary_mode_refuses_words_too_long_for_its_prefix(self):
+        with open(self.path('long.txt'), 'w') as f:
+            f.write('a,' + 'x' * 65536 + ',b')
+        self.assertIsNone(self.start(self.path('long.txt')))
+        # The connection stays in text mode
+        self.assertEqual(self.lines('MODE binary', '2,1', 'MODE text'), ['ERR word too long', 'b', 'OK text'])
+
+    def test_client_refuses_frames_on_text_only_paths(self):
+        # Delta sync parses text replies, so a binary mode there would be misread
+        self.assertIsNone(self.start(self.path('words.txt')))
+        with self.assertRaises(subprocess.CalledProcessError):
+            self.client_counts('--mode', 'binary', '--cache', self.path('words.cache'))
+        self.assertEqual(self.client_counts('--mode', 'binary'), {'a': 1, 'b': 1, 'c': 1, 'd': 1, 'e': 1})
+
+    def test_multicast_packets_carry_long_and_empty_words(self):
+        # Check the packets through NACK repair, which returns each one over TCP
+        words = ['a', '', 'x' * 3000, '', '', 'b', 'y' * 1399, '', 'c']
+        with open(self.path('mcast.txt'), 'w') as f:
+            f.write(','.join(words))
+        self.assertIsNone(self.start(self.path('mcast.txt'), mcast_group='239.255.0.77'))
+        mcast = self.lines('SUBSCRIBE')[0]
+        self.assertTrue(mcast.startswith('MCAST '), mcast)
+        count = int(mcast.split(',')[2])
+        payloads = self.lines('NACK ' + ','.join(map(str, range(count))), replies=count)
+        self.assertEqual([p.split(':', 1)[0] for p in payloads], [str(i) for i in range(count)])
+        payloads = [p.split(':', 1)[1] for p in payloads]
+        self.assertTrue(all(len(p) <= 1400 for p in payloads))
+        self.assertEqual(''.join(payloads).split(','), words)
+
+    def test_http10_keep_alive_is_echoed(self):
+        http_port = free_port()
+        self.assertIsNone(self.start(self.path('words.txt'), http_port=http_port))
+        request = 'GET /words?p=%d&k=2 HTTP/1.0\r\nConnection: keep-alive\r\n\r\n'
+        with socket.create_connection(('127.0.0.1', http_port), timeout=5) as s:
+            s.sendall(((request % 0) + (request % 2) + 'GET /words?p=4&k=1 HTTP/1.0\r\n\r\n').encode())
+            data = b''
+            while True:  # the last request has no keep-alive, so the server closes
+                chunk = s.recv(4096)
+                if not chunk:
+                    break
+                data += chunk
+        replies = data.decode().split('HTTP/1.1 ')[1:]
+        self.assertEqual(len(replies), 3, data)
+        for reply, connection, body in zip(replies, ['keep-alive', 'keep-alive', 'close'], ['a,b\n', 'c,d\n', 'e\n']):
+            self.assertIn('Connection: %s\r\n' % connection, reply)
+            self.assertTrue(reply.endswith('\r\n\r\n' + body), reply)
+
+    def test_scheduled_replies_keep_request_order(self):
+        # Inline replies wait behind queued ones, NEXT and COUNT are queued too, and an
+        # earlier edf deadline on a later request does not reorder the replies
+        self.assertIsNone(self.start(self.path('words.txt'), scheduler='edf', service_us=20000))
+        replies = self.lines('0,2,1000', 'MODE text', '2,1,0', 'OPEN 1,2', 'NEXT 3', 'COUNT 0,2', replies=8)
+        self.assertEqual(replies[:3], ['a,b', 'OK text', 'c'])
+        self.assertTrue(replies[3].startswith('OK '), replies[3])
+        self.assertEqual(replies[4:7], ['b,c', 'd,e', 'EOF'])
+        self.assertEqual(replies[7], 'a:1,b:1')
+
+
+if __name__ == '__main__':
+    unittest.main()
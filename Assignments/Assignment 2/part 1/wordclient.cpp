@@ -0,0 +1,150 @@
+// wordclient.cpp
+#include "wordclient.h"
+#include <string>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstring>
+
+struct wc_client {
+    int sock = -1;
+    std::string inbuf;
+    size_t scanned = 0;  // inbuf bytes already searched for a newline
+    std::unordered_map<std::string, long long> counts;
+    std::string error;
+};
+
+static long long fail(wc_client* c, const char* what) {
+    c->error = what;
+    return -1;
+}
+
+static bool send_all(wc_client* c, const std::string& data) {
+    size_t off = 0;
+    while (off < data.size()) {
+        ssize_t n = send(c->sock, data.data() + off, data.size() - off, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        off += n;
+    }
+    return true;
+}
+
+// Read one newline-terminated line, keeping any extra bytes for the next call
+static bool read_line(wc_client* c, std::string& line) {
+    size_t nl;
+    while ((nl = c->inbuf.find('\n', c->scanned)) == std::string::npos) {
+        c->scanned = c->inbuf.size();
+        char chunk[65536];
+        ssize_t bytes_read = read(c->sock, chunk, sizeof(chunk));
+        if (bytes_read <= 0) return false;
+        c->inbuf.append(chunk, bytes_read);
+    }
+    line.assign(c->inbuf, 0, nl);
+    c->inbuf.erase(0, nl + 1);
+    c->scanned = 0;
+    return true;
+}
+
+// Send batch "p,k" requests back to back, then read their replies; stop at the
+// reply that carries EOF. Replies still due after it are read and dropped so the
+// connection stays usable.
+template <typename OnLine>
+static long long fetch_lines(wc_client* c, int p, int k, int batch, OnLine on_line) {
+    if (k <= 0 || batch <= 0) return fail(c, "k and batch must be positive");
+    long long lines = 0;
+    int offset = p;
+    bool eof = false;
+    std::string line;
+    while (!eof) {
+        std::string requests;
+        for (int i = 0; i < batch; ++i) requests += std::to_string(offset + i * k) + "," + std::to_string(k) + "\n";
+        if (!send_all(c, requests)) return fail(c, "send failed");
+        for (int i = 0; i < batch; ++i) {
+            if (!read_line(c, line)) return fail(c, "connection closed before EOF");
+            if (eof) continue;
+            eof = line.find("EOF") != std::string::npos;
+            on_line(line);
+            lines++;
+        }
+        offset += batch * k;
+    }
+    return lines;
+}
+
+extern "C" {
+
+wc_client* wc_connect(const char* ip, int port, int timeout_ms) {
+    struct sockaddr_in serv_addr = {};
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip, &serv_addr.sin_addr) <= 0) return nullptr;
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return nullptr;
+    if (timeout_ms > 0) {
+        struct timeval tv = {timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    }
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sock);
+        return nullptr;
+    }
+    wc_client* c = new wc_client;
+    c->sock = sock;
+    return c;
+}
+
+void wc_close(wc_client* c) {
+    if (!c) return;
+    close(c->sock);
+    delete c;
+}
+
+long long wc_fetch(wc_client* c, int p, int k, int batch, wc_line_fn fn, void* user) {
+    return fetch_lines(c, p, k, batch, [&](const std::string& line) { fn(user, line.data(), line.size()); });
+}
+
+long long wc_fetch_count(wc_client* c, int p, int k, int batch) {
+    long long words = 0;
+    long long lines = fetch_lines(c, p, k, batch, [&](const std::string& line) {
+        // Words before the EOF marker, split on commas as they arrive
+        size_t end = line.find("EOF");
+        if (end == std::string::npos) end = line.size();
+        size_t start = 0;
+        while (start < end) {
+            size_t comma = line.find(',', start);
+            if (comma == std::string::npos || comma > end) comma = end;
+            if (comma > start) {
+                c->counts[line.substr(start, comma - start)]++;
+                words++;
+            }
+            start = comma + 1;
+        }
+    });
+    return lines < 0 ? -1 : words;
+}
+
+size_t wc_counts_dump(wc_client* c, char* out, size_t cap) {
+    size_t need = 0;
+    bool fits = true;
+    for (const auto& pair : c->counts) {
+        std::string entry = pair.first + "\t" + std::to_string(pair.second) + "\n";
+        fits = fits && need + entry.size() <= cap;
+        if (fits) memcpy(out + need, entry.data(), entry.size());
+        need += entry.size();
+    }
+    return need;
+}
+
+void wc_reset(wc_client* c) {
+    c->counts.clear();
+}
+
+const char* wc_error(wc_client* c) {
+    return c->error.c_str();
+}
+
+}
@@ -0,0 +1,43 @@
+// wordclient.h
+// C ABI of libwordclient.so: the fast client path (connect, pipelined fetch,
+// streaming word count) for callers outside C++, e.g. the Python clients in parts 2-4
+// through wordclient.py
+#ifndef WORDCLIENT_H
+#define WORDCLIENT_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wc_client wc_client;
+
+// Called once per response line, without the newline
+typedef void (*wc_line_fn)(void* user, const char* line, size_t len);
+
+// Connect to the word server; NULL on failure. timeout_ms bounds each read (0: none).
+wc_client* wc_connect(const char* ip, int port, int timeout_ms);
+void wc_close(wc_client* c);
+
+// Request [p, EOF) in chunks of k, sending batch requests back to back and then
+// reading their replies. Each reply line goes to fn. Returns the number of lines,
+// or -1 on error (see wc_error).
+long long wc_fetch(wc_client* c, int p, int k, int batch, wc_line_fn fn, void* user);
+
+// Same requests, but the words are counted as the replies arrive. Counts add up over
+// calls until wc_reset. Returns the number of words counted, or -1 on error.
+long long wc_fetch_count(wc_client* c, int p, int k, int batch);
+
+// Write the counts as "word\tcount\n" lines into out (up to cap bytes) and return the
+// size they need, so a first call with cap 0 sizes the buffer
+size_t wc_counts_dump(wc_client* c, char* out, size_t cap);
+void wc_reset(wc_client* c);
+
+const char* wc_error(wc_client* c);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# ctypes bindings for libwordclient.so (build it here with: make libwordclient.so).
+# The Python clients in parts 2-4 use it when their config has "native": true, so
+# splitting and counting happen in C++ instead of per word in Python.
+
+import ctypes
+import os
+
+LIB_PATH = os.environ.get('WORDCLIENT_LIB', os.path.join(os.path.dirname(os.path.abspath(__file__)), 'libwordclient.so'))
+
+_LINE_FN = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t)
+_lib = None
+
+
+def load():
+    """Load the shared library once; returns None if it has not been built."""
+    global _lib
+    if _lib is None:
+        try:
+            lib = ctypes.CDLL(LIB_PATH)
+        except OSError:
+            return None
+        lib.wc_connect.restype = ctypes.c_void_p
+        lib.wc_connect.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+        lib.wc_close.argtypes = [ctypes.c_void_p]
+        lib.wc_fetch.restype = ctypes.c_longlong
+        lib.wc_fetch.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int, _LINE_FN, ctypes.c_void_p]
+        lib.wc_fetch_count.restype = ctypes.c_longlong
+        lib.wc_fetch_count.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+        lib.wc_counts_dump.restype = ctypes.c_size_t
+        lib.wc_counts_dump.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        lib.wc_reset.argtypes = [ctypes.c_void_p]
+        lib.wc_error.restype = ctypes.c_char_p
+        lib.wc_error.argtypes = [ctypes.c_void_p]
+        _lib = lib
+    return _lib
+
+
+def available():
+    return load() is not None
+
+
+class NativeClient:
+    """One connection to the word server, driven by libwordclient.so."""
+
+    def __init__(self, server_ip, port, timeout=30.0):
+        self.lib = load()
+        if self.lib is None:
+            raise OSError(f"{LIB_PATH} not found (run make libwordclient.so in part 1)")
+        self.handle = self.lib.wc_connect(server_ip.encode(), int(port), int(timeout * 1000))
+        if not self.handle:
+            raise ConnectionError(f"cannot connect to {server_ip}:{port}")
+
+    def _check(self, result):
+        if result < 0:
+            raise ConnectionError(self.lib.wc_error(self.handle).decode())
+        return result
+
+    def fetch_count(self, p, k, batch=1):
+        """Download [p, EOF) in chunks of k, batch requests at a time, counting the words
+        in C++; returns the number of words counted."""
+        return self._check(self.lib.wc_fetch_count(self.handle, p, k, batch))
+
+    def fetch(self, p, k, batch=1):
+        """Same requests, returning the raw reply lines."""
+        lines = []
+        callback = _LINE_FN(lambda user, data, size: lines.append(ctypes.string_at(data, size).decode()))
+        self._check(self.lib.wc_fetch(self.handle, p, k, batch, callback, None))
+        return lines
+
+    def counts(self):
+        """Word counts accumulated by fetch_count, as a dict."""
+        size = self.lib.wc_counts_dump(self.handle, None, 0)
+        buf = ctypes.create_string_buffer(size)
+        self.lib.wc_counts_dump(self.handle, buf, size)
+        result = {}
+        for entry in buf.raw[:size].decode().splitlines():
+            word, count = entry.rsplit('\t', 1)
+            result[word] = int(count)
+        return result
+
+    def reset(self):
+        self.lib.wc_reset(self.handle)
+
+    def close(self):
+        if self.handle:
+            self.lib.wc_close(self.handle)
+            self.handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
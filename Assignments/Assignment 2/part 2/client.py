@@ -5,6 +5,15 @@ import socket
 import json
 import time
 import argparse
+import os
+import sys
+
+# Optional native fast path from part 1 (make libwordclient.so there, then set "native": true)
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'part 1'))
+try:
+    import wordclient
+except ImportError:
+    wordclient = None
 
 # Connect to the server and download the word file
 def download_file(config, client_id, quiet):
@@ -67,6 +76,29 @@ def download_file(config, client_id, quiet):
             
     return completion_time
 
+# Same download through libwordclient: replies are split and counted in C++
+def download_file_native(config, client_id, quiet):
+    p = config['p']
+    k = config.get('k_override', config['k'])
+
+    start_time = time.time()
+    try:
+        with wordclient.NativeClient(config['server_ip'], config['port']) as native:
+            native.fetch_count(p, k)
+            word_counts = native.counts()
+    except Exception as e:
+        if not quiet:
+            print(f"[{client_id}] Error: {e}")
+        return None
+    completion_time = time.time() - start_time
+
+    if not quiet:
+        print(f"[{client_id}] Download complete in {completion_time:.3f} seconds.")
+        for word, count in sorted(word_counts.items()):
+            print(f"{word}, {count}")
+
+    return completion_time
+
 # Parses arguments and runs the client
 
 def main():
@@ -84,7 +116,12 @@ def main():
     if args.k:
         config['k_override'] = args.k
         
-    download_file(config, args.client_id, args.quiet)
+    if config.get('native') and wordclient is not None and wordclient.available():
+        download_file_native(config, args.client_id, args.quiet)
+    else:
+        if config.get('native') and not args.quiet:
+            print(f"[{args.client_id}] libwordclient.so not built, using the Python path")
+        download_file(config, args.client_id, args.quiet)
 
 if __name__ == "__main__":
     main()
\ No newline at end of file
@@ -7,6 +7,13 @@ import os
 import sys
 import traceback
 
+# Optional native fast path from part 1 (make libwordclient.so there, then set "native": true)
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'part 1'))
+try:
+    import wordclient
+except ImportError:
+    wordclient = None
+
 class WordCountingClient:
     def __init__(self, config_file='config.json', batch_size=1, client_id='client'):
         try:
@@ -23,6 +30,10 @@ class WordCountingClient:
         
         self.batch_size = batch_size
         self.client_id = client_id
+        self.native = bool(self.config.get('native', False))
+        if self.native and (wordclient is None or not wordclient.available()):
+            print(f"Client {self.client_id}: libwordclient.so not built, using the Python path")
+            self.native = False
         
         os.makedirs('logs', exist_ok=True)
         self.word_counts = {}
@@ -42,10 +53,22 @@ class WordCountingClient:
                 for word in words:
                     self.word_counts[word] = self.word_counts.get(word, 0) + 1
 
+    def download_file_native(self):
+        # Same burst pattern, but reading and counting happen in libwordclient
+        with wordclient.NativeClient(self.server_ip, self.port, timeout=30.0) as native:
+            print(f"[{self.client_id}] Connected successfully (native).")
+            native.fetch_count(self.p, self.k, self.batch_size)
+            for word, count in native.counts().items():
+                self.word_counts[word] = self.word_counts.get(word, 0) + count
+
     def download_file(self):
         start_time = time.time()
         
         try:
+            if self.native:
+                self.download_file_native()
+                return self.record_completion(start_time)
+
             sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
             sock.settimeout(30.0) # More reasonable timeout
             sock.connect((self.server_ip, self.port))
@@ -122,6 +145,9 @@ class WordCountingClient:
             traceback.print_exc()
             sys.exit(1) # Ensure the runner knows this client failed
 
+        return self.record_completion(start_time)
+
+    def record_completion(self, start_time):
         end_time = time.time()
         total_time = (end_time - start_time) * 1000
 
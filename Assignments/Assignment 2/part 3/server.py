@@ -124,6 +124,11 @@ class FCFSServer:
         self.logger.info("Server stopped.")
 
 def main():
+    # "native_server": true hands the port to the C++ server's FCFS scheduler (part 1)
+    with open('config.json', 'r') as f:
+        if json.load(f).get('native_server'):
+            shim = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'part 1', 'sched_server.py')
+            os.execv(sys.executable, [sys.executable, shim, '--policy', 'fcfs'])
     server = FCFSServer()
     try:
         server.start()